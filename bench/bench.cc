@@ -14,12 +14,25 @@
 #include <sys/types.h>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
 #include <memory>
+#include <vector>
 #include <chrono>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <time.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 
 #include "leveldb/env.h"
 #include "testutil.h"
 #include "port/port_posix.h"
+#include "hdr_histogram.h"
 #include "histogram.h"
 #include "mutexlock.h"
 #include "random.h"
@@ -30,7 +43,11 @@ extern "C" {
 
 static const std::string USAGE =
         "pmkv_bench\n"
-        "--engine=<name>            (storage engine name, default: pmkv)\n"
+        "--engine=<name>            (storage engine: pmkv, noop (no storage, measures the\n"
+        "                            harness), dram (a hash map in DRAM), or a pmemkv engine\n"
+        "                            such as cmap, stree or tree3; default: pmkv)\n"
+        "--calibrate=<0|1>          (rerun each benchmark on noop and dram and report the\n"
+        "                            engine's time per op over both, default: 0)\n"
         "--db=<location>            (path to persistent pool, default: /mnt/ramdisk/bench)\n"
         "                           (note: file on DAX filesystem, DAX device, or poolset file)\n"
         "--db_size_in_gb=<integer>  (size of persistent pool to create in GB, default: 1)\n"
@@ -42,6 +59,36 @@ static const std::string USAGE =
         "--threads=<integer>        (number of concurrent threads, default: 1)\n"
         "--key_size=<integer>         (size of keys in bytes, default: 16)\n"
         "--value_size=<integer>     (size of values in bytes, default: 100)\n"
+        "--pool_passes=<integer>    (times the pool size written by sustainedoverwrite, default: 3)\n"
+        "--compression=<name>       (value codec of the pmkv engine: none, zstd, default: none)\n"
+        "--compress_min=<integer>   (smallest value in bytes the codec is tried on, default: 1024)\n"
+        "--compression_ratio=<double> (fraction of its size a generated value compresses to,\n"
+        "                            default: 1.0)\n"
+        "--cache_mb=<integer>       (DRAM read cache of the pmkv engine in MB, default: 0 = off)\n"
+        "--zipf_theta=<double>      (skew of zipfian key choice, default: 0.99)\n"
+        "--key_dist=<name>          (key choice of the random benchmarks: uniform, zipfian,\n"
+        "                            scrambled_zipfian, hotspot (80% of requests to 20% of\n"
+        "                            keys), latest, sequential; default: uniform, and each\n"
+        "                            ycsb workload's own)\n"
+        "--seed=<integer>           (thread i seeds its random generator with seed + i,\n"
+        "                            default: 1000)\n"
+        "--duration=<integer>       (run each benchmark for this many seconds instead of its\n"
+        "                            op count, except ycsbload; default: 0 = op count)\n"
+        "--report_interval=<double> (print throughput and latency of the last interval every\n"
+        "                            this many seconds, default: 0 = off)\n"
+        "--target_qps=<double>      (issue ops open-loop at this total rate, latency counted\n"
+        "                            from each op's intended send time; default: 0 = closed-loop)\n"
+        "--arrival=<name>           (open-loop arrivals: poisson, constant; default: poisson)\n"
+        "--output_format=<name>     (also write per-thread and aggregate results as json or\n"
+        "                            csv, default: text only)\n"
+        "--output_file=<path>       (file for --output_format, default: bench.json or bench.csv)\n"
+        "--ycsb_records=<integer>   (records ycsbload inserts, default: 1000000)\n"
+        "--ycsb_ops=<integer>       (operations a ycsb workload runs over all threads,\n"
+        "                            default: 1000000)\n"
+        "--hash=<name>              (key hash kernel of a new pool: auto, portable, crc32c, aes;\n"
+        "                            default: auto)\n"
+        "--fixed_key=<0|1>          (create the pool for fixed 16-byte keys stored inline in the\n"
+        "                            index; needs --key_size=16, default: 0)\n"
         "--readwritepercent=<integer> (Ratio of reads to reads/writes (expressed "
         "as percentage) for the ReadRandomWriteRandom workload. The default value "
         "90 means 90% operations out of all reads and writes operations are reads. "
@@ -53,10 +100,21 @@ static const std::string USAGE =
         "    readseq                (read N values in sequential key order)\n"
         "    readrandom             (read N values in random key order)\n"
         "    readmissing            (read N missing values in random key order)\n"
+        "    readzipfian            (read N values with zipfian key popularity)\n"
+        "    hashkeys               (hash --reads keys with the pool's hash kernel, no PM access)\n"
         "    deleteseq              (delete N values in sequential key order)\n"
         "    deleterandom           (delete N values in random key order)\n"
         "    readwhilewriting       (1 writer, N threads doing random reads)\n"
-        "    readrandomwriterandom  (N threads doing random-read, random-write)\n";
+        "    readrandomwriterandom  (N threads doing random-read, random-write)\n"
+        "    sustainedoverwrite     (overwrite N keys with resized values until the pool\n"
+        "                            would have filled --pool_passes times)\n"
+        "    ycsbload               (insert --ycsb_records records for the ycsb workloads)\n"
+        "    ycsba                  (YCSB A: 50% read, 50% update, zipfian)\n"
+        "    ycsbb                  (YCSB B: 95% read, 5% update, zipfian)\n"
+        "    ycsbc                  (YCSB C: 100% read, zipfian)\n"
+        "    ycsbd                  (YCSB D: 95% read, 5% insert, latest)\n"
+        "    ycsbe                  (YCSB E: 95% scan, 5% insert, zipfian)\n"
+        "    ycsbf                  (YCSB F: 50% read, 50% read-modify-write, zipfian)\n";
 
 // Default list of comma-separated operations to run
 static const char *FLAGS_benchmarks =
@@ -88,14 +146,85 @@ static const char *FLAGS_db = "/mnt/ramdisk/bench";
 // Use following size when opening the database.
 static int FLAGS_db_size_in_gb = 1;
 
-static const double FLAGS_compression_ratio = 1.0;
+// Extend an existing pool by this much at open (poolsets with a directory part)
+static int FLAGS_grow_in_gb = 0;
+
+// Fraction of its size a generated value compresses to
+static double FLAGS_compression_ratio = 1.0;
+
+// Value codec of the pmkv engine and the smallest value it is tried on
+static int FLAGS_codec = PMKV_CODEC_NONE;
+static const char *codec_names[] = { "none", "zstd" };
+static int FLAGS_compress_min = 1024;
 
 static const int FLAGS_ops_between_duration_checks = 1000;
 
-static const int FLAGS_duration = 0;
+// Run each benchmark for this many seconds instead of for its op count;
+// 0 uses the op count
+static int FLAGS_duration = 0;
+
+// Print throughput and latency of the last interval every this many seconds
+// while a benchmark runs; 0 turns it off
+static double FLAGS_report_interval = 0;
 
 static int FLAGS_readwritepercent = 90;
 
+// Multiple of the pool size written by sustainedoverwrite
+static int FLAGS_pool_passes = 3;
+
+// Size of the engine's DRAM read cache in MB, 0 to disable it
+static int FLAGS_cache_mb = 0;
+
+// Zipfian constant for skewed key choice
+static double FLAGS_zipf_theta = 0.99;
+
+// Key choice of the random benchmarks (enum KeyDist); -1 is uniform, and
+// each ycsb workload's own distribution
+static int FLAGS_key_dist = -1;
+
+// Thread i seeds its Random with seed + i
+static int FLAGS_seed = 1000;
+
+// Key hash kernel used when creating the pool
+static int FLAGS_hash = PMKV_HASH_AUTO;
+static const char *hash_names[] = { "auto", "portable", "crc32c", "aes" };
+
+// Create the pool for fixed --key_size keys, kept inline in the index. A flag of
+// its own rather than implied by --key_size=16: that is the default key size, and
+// the variable layout must stay the default and be measurable at the same size.
+static bool FLAGS_fixed_key = false;
+
+// Pin thread i to node i % (pools in --db) and report local/remote accesses
+static bool FLAGS_numa = false;
+
+// Records ycsbload inserts, and operations each ycsb workload runs in total
+static int FLAGS_ycsb_records = 1000000;
+static int FLAGS_ycsb_ops = 1000000;
+
+// Ops per second all threads issue together on an open-loop schedule, each
+// op's latency counted from its intended send time; 0 runs closed-loop
+static double FLAGS_target_qps = 0;
+
+// Arrivals of the open-loop schedule: exponential gaps, or evenly spaced
+static bool FLAGS_poisson = true;
+
+// Rerun every benchmark on the noop and dram engines and report how the
+// engine under test compares with both
+static bool FLAGS_calibrate = false;
+
+enum OutputFormat { kText = 0, kJson, kCsv };
+static const char *output_format_names[] = { "text", "json", "csv" };
+
+// Also write the results as json or csv to --output_file (default bench.json
+// or bench.csv)
+static int FLAGS_output_format = kText;
+static const char *FLAGS_output_file = NULL;
+
+// Revision the binary was built from, set by the Makefile
+#ifndef BENCH_GIT_REV
+#define BENCH_GIT_REV "unknown"
+#endif
+
 using namespace leveldb;
 using namespace pmem::kv;
 
@@ -115,8 +244,70 @@ static Slice TrimSpace(Slice s) {
     return Slice(s.data() + start, limit - start);
 }
 
+static void ReadCpuInfo(int *num_cpus, std::string *cpu_type, std::string *cache_size) {
+    *num_cpus = 0;
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo == NULL)
+        return;
+    char line[1000];
+    while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+        const char *sep = strchr(line, ':');
+        if (sep == NULL) {
+            continue;
+        }
+        Slice key = TrimSpace(Slice(line, sep - 1 - line));
+        Slice val = TrimSpace(Slice(sep + 1));
+        if (key == "model name") {
+            ++*num_cpus;
+            *cpu_type = val.ToString();
+        } else if (key == "cache size") {
+            *cache_size = val.ToString();
+        }
+    }
+    fclose(cpuinfo);
+}
+
 #endif
 
+// s as a quoted JSON string
+static std::string JsonString(const std::string &s) {
+    std::string r = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            r.push_back('\\');
+            r.push_back(c);
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            r.append(buf);
+        } else {
+            r.push_back(c);
+        }
+    }
+    r.push_back('"');
+    return r;
+}
+
+// The pools --db names: one, or one per NUMA node when it lists several
+static std::vector<std::string> DbPaths() {
+    std::vector<std::string> paths;
+    std::string db(FLAGS_db);
+    size_t pos = 0, comma;
+    do {
+        comma = db.find(',', pos);
+        paths.push_back(db.substr(pos, comma - pos));
+        pos = comma + 1;
+    } while (comma != std::string::npos);
+    return paths;
+}
+
+
+// Keys and values go to the engines as views of the harness's own buffers,
+// so no op allocates
+static inline string_view AsView(const Slice &s) {
+    return string_view(s.data(), s.size());
+}
 
 // Helper for quickly generating random data.
 class RandomGenerator {
@@ -159,6 +350,149 @@ class RandomGenerator {
   }
 };
 
+// Zipfian key ranks in [0, n), rank 0 being the most popular, using the
+// method of Gray et al., "Quickly Generating Billion-Record Synthetic
+// Databases".  Setup costs O(n); Next() is O(1) and callers supply the
+// uniform draw so every thread can use its own Random.
+class ZipfianGenerator {
+private:
+    uint64_t n_;
+    double theta_;
+    double alpha_;
+    double zetan_;
+    double eta_;
+    double half_pow_theta_;
+
+    static double Zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++) {
+            sum += 1.0 / std::pow((double)i, theta);
+        }
+        return sum;
+    }
+
+public:
+    ZipfianGenerator(uint64_t n, double theta) : n_(n), theta_(theta) {
+        double zeta2 = Zeta(2, theta);
+        zetan_ = Zeta(n, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+        half_pow_theta_ = 1.0 + std::pow(0.5, theta);
+    }
+
+    uint64_t Next(Random &rand) const {
+        double u = rand.Next() / 2147483647.0;
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < half_pow_theta_) return 1;
+        uint64_t r = (uint64_t)(n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+        return r < n_ ? r : n_ - 1;
+    }
+};
+
+// FNV-1a over the 8 bytes of v, as YCSB scrambles zipfian ranks
+static inline uint64_t FNVHash64(uint64_t v) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; i++) {
+        hash ^= v & 0xff;
+        hash *= 1099511628211ULL;
+        v >>= 8;
+    }
+    return hash;
+}
+
+enum KeyDist {
+    kUniform = 0,
+    kZipfian,           // key i has popularity rank i
+    kScrambledZipfian,  // zipfian ranks hashed over the key space
+    kHotspot,           // kHotspotOps% of requests go to the first kHotspotKeys% of keys
+    kLatest,            // zipfian from the highest key down
+    kSequential,        // consecutive keys from a per-thread start
+    kNumKeyDists
+};
+
+static const char *key_dist_names[kNumKeyDists] = {
+    "uniform", "zipfian", "scrambled_zipfian", "hotspot", "latest", "sequential"
+};
+
+static const int kHotspotKeys = 20;
+static const int kHotspotOps = 80;
+
+static inline bool KeyDistZipfian(int dist) {
+    return dist == kZipfian || dist == kScrambledZipfian || dist == kLatest;
+}
+
+// Key numbers for one thread.  The zipfian generator is shared and
+// precomputed; every draw comes from the thread's own Random.
+class KeyGenerator {
+private:
+    int dist_;
+    Random *rand_;
+    const ZipfianGenerator *zipf_;
+    int64_t next_;
+
+    int64_t Uniform(int64_t n) {
+        if (n <= 2147483647)
+            return rand_->Next() % n;
+        return (((uint64_t)rand_->Next() << 31) | rand_->Next()) % n;
+    }
+
+public:
+    KeyGenerator(int dist, Random *rand, const ZipfianGenerator *zipf, int64_t start)
+            : dist_(dist), rand_(rand), zipf_(zipf), next_(start) {
+    }
+
+    // Next key number in [0, n); zipfian ranks beyond the generator's range
+    // are never drawn, so n may grow past it as keys are inserted.
+    int64_t Next(int64_t n) {
+        switch (dist_) {
+        case kZipfian: {
+            int64_t rank = zipf_->Next(*rand_);
+            return rank < n ? rank : n - 1;
+        }
+        case kScrambledZipfian:
+            return FNVHash64(zipf_->Next(*rand_)) % n;
+        case kHotspot: {
+            int64_t hot = std::max<int64_t>(n * kHotspotKeys / 100, 1);
+            if (hot >= n || (int)(rand_->Next() % 100) < kHotspotOps)
+                return Uniform(hot);
+            return hot + Uniform(n - hot);
+        }
+        case kLatest: {
+            int64_t rank = zipf_->Next(*rand_);
+            return rank < n ? n - 1 - rank : 0;
+        }
+        case kSequential:
+            return next_++ % n;
+        default:
+            return Uniform(n);
+        }
+    }
+};
+
+// YCSB core workloads: operation mix in percent and the default request
+// distribution, scrambled zipfian or, for D, the latest inserts.
+struct YcsbWorkload {
+    int read;
+    int update;
+    int insert;
+    int scan;
+    int rmw;
+    int dist;
+};
+
+static const YcsbWorkload ycsb_workloads[] = {
+    { 50, 50, 0, 0, 0, kScrambledZipfian },     // a: update heavy
+    { 95, 5, 0, 0, 0, kScrambledZipfian },      // b: read mostly
+    { 100, 0, 0, 0, 0, kScrambledZipfian },     // c: read only
+    { 95, 0, 5, 0, 0, kLatest },                // d: read latest
+    { 0, 0, 5, 95, 0, kScrambledZipfian },      // e: short ranges
+    { 50, 0, 0, 0, 50, kScrambledZipfian },     // f: read-modify-write
+};
+
+// Scans cover a uniform 1..kYcsbMaxScan records
+static const int kYcsbMaxScan = 100;
+
 static void AppendWithSpace(std::string *str, Slice msg) {
     if (msg.empty()) return;
     if (!str->empty()) {
@@ -174,6 +508,141 @@ enum OperationType : unsigned char {
     kSeek,
     kMerge,
     kUpdate,
+    kInsert,
+    kScan,
+    kReadModifyWrite,
+    kOthers,
+    kNumOpTypes
+};
+
+static const char *op_names[kNumOpTypes] = {
+    "read", "write", "delete", "seek", "merge", "update", "insert", "scan", "rmw", "other"
+};
+
+// Op timestamps come from rdtscp when the TSC is invariant, calibrated
+// against CLOCK_MONOTONIC_RAW by InitTimer(), and from the clock otherwise.
+static double g_tsc_nanos = 0;          // nanoseconds per TSC tick, 0 = no TSC
+static double g_timer_overhead = 0;     // nanoseconds a NowNanos() call costs
+
+static inline uint64_t ClockNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline uint64_t NowNanos() {
+#if defined(__x86_64__)
+    if (g_tsc_nanos > 0) {
+        unsigned int aux;
+        return (uint64_t)(__rdtscp(&aux) * g_tsc_nanos);
+    }
+#endif
+    return ClockNanos();
+}
+
+static void InitTimer() {
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+    // rdtscp is CPUID 0x80000001 EDX bit 27, invariant TSC 0x80000007 EDX bit 8
+    if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (edx & (1u << 27)) &&
+        __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8))) {
+        unsigned int aux;
+        uint64_t t0 = ClockNanos();
+        uint64_t c0 = __rdtscp(&aux);
+        while (ClockNanos() - t0 < 20000000)
+            ;
+        uint64_t t1 = ClockNanos();
+        uint64_t c1 = __rdtscp(&aux);
+        g_tsc_nanos = (double)(t1 - t0) / (c1 - c0);
+    }
+#endif
+    // best of 100 runs of 1000 back-to-back readings
+    volatile uint64_t sink = 0;
+    double best = 1e9;
+    for (int r = 0; r < 100; r++) {
+        uint64_t start = NowNanos();
+        for (int i = 0; i < 1000; i++)
+            sink += NowNanos();
+        best = std::min(best, (NowNanos() - start) / 1000.0);
+    }
+    g_timer_overhead = best;
+}
+
+// Prints the throughput and latency of every --report_interval while a
+// benchmark runs.  Threads keep the latencies of the current interval in
+// their Stats and hand them over at their first op after the reporter moves
+// on, so an op only pays for one relaxed load.
+class IntervalReporter {
+private:
+    uint64_t interval_nanos_;
+    std::atomic<int> interval_;
+    std::atomic<bool> stop_;
+    port::Mutex mu_;
+    HdrHistogram hist_[3];      // by interval % 3: filling, handed over, printed
+    std::thread thread_;
+
+    void Print(int k, double seconds, double end) {
+        HdrHistogram h;
+        mu_.Lock();
+        h = hist_[k % 3];
+        hist_[k % 3].Clear();
+        mu_.Unlock();
+        char label[32];
+        snprintf(label, sizeof(label), "@%.1fs", end);
+        fprintf(stdout, "  %-10s : %11.0f ops/sec; p50 %.3f p99 %.3f max %.3f micros\n",
+                label, h.Count() / seconds, h.Percentile(50) * 1e-3,
+                h.Percentile(99) * 1e-3, h.Max() * 1e-3);
+        fflush(stdout);
+    }
+
+    void Run() {
+        uint64_t start = NowNanos();
+        int k = 0;
+        for (;;) {
+            uint64_t tick = start + (k + 1) * interval_nanos_;
+            uint64_t now;
+            // sleep in slices so that Stop() is not held up
+            while (!stop_.load() && (now = NowNanos()) < tick)
+                g_env->SleepForMicroseconds(std::min<uint64_t>((tick - now) / 1000 + 1, 10000));
+            if (stop_.load())
+                break;
+            interval_.store(k + 1, std::memory_order_relaxed);
+            // give the threads a moment to hand over interval k
+            g_env->SleepForMicroseconds(std::min<uint64_t>(interval_nanos_ / 10000, 10000));
+            Print(k, interval_nanos_ * 1e-9, (tick - start) * 1e-9);
+            k++;
+        }
+        // the threads handed over the rest when they stopped
+        uint64_t end = NowNanos();
+        uint64_t from = start + k * interval_nanos_;
+        if (end > from)
+            Print(k, (end - from) * 1e-9, (end - start) * 1e-9);
+    }
+
+public:
+    explicit IntervalReporter(double seconds)
+            : interval_nanos_((uint64_t)(seconds * 1e9)), interval_(0), stop_(false) {
+    }
+
+    void Start() {
+        thread_ = std::thread(&IntervalReporter::Run, this);
+    }
+
+    // Prints the interval in progress; every thread must have stopped
+    void Stop() {
+        stop_.store(true);
+        thread_.join();
+    }
+
+    int Current() const { return interval_.load(std::memory_order_relaxed); }
+
+    void Publish(int k, const HdrHistogram &h) {
+        if (h.Count() == 0)
+            return;
+        mu_.Lock();
+        hist_[k % 3].Merge(h);
+        mu_.Unlock();
+    }
 };
 
 class Stats {
@@ -184,17 +653,66 @@ private:
     int done_;
     int next_report_;
     int64_t bytes_;
-    double last_op_finish_;
     Histogram hist_;
     std::string message_;
     bool exclude_from_merge_;
+    // latencies in nanoseconds by OperationType
+    HdrHistogram op_hist_[kNumOpTypes];
+    uint64_t last_op_nanos_;
+    // open-loop schedule: mean gap between sends, 0 for closed-loop
+    double interval_ns_;
+    double next_send_;
+    Random arrivals_;
+    // latencies of the current --report_interval, all types together
+    IntervalReporter *reporter_;
+    int interval_;
+    HdrHistogram interval_hist_;
+
+    // Waits for the intended send time of the next op and returns it
+    uint64_t NextSend(uint64_t now) {
+        double gap = interval_ns_;
+        if (FLAGS_poisson) {
+            gap *= -log(arrivals_.Next() / 2147483647.0);
+        }
+        next_send_ += gap;
+        uint64_t send = (uint64_t)next_send_;
+        if (send > now + 200000) {
+            g_env->SleepForMicroseconds((send - now) / 1000 - 100);
+        }
+        while (NowNanos() < send)
+            ;
+        return send;
+    }
+
+    void Done() {
+        done_++;
+        if (done_ >= next_report_) {
+            if (next_report_ < 1000) next_report_ += 100;
+            else if (next_report_ < 5000) next_report_ += 500;
+            else if (next_report_ < 10000) next_report_ += 1000;
+            else if (next_report_ < 50000) next_report_ += 5000;
+            else if (next_report_ < 100000) next_report_ += 10000;
+            else if (next_report_ < 500000) next_report_ += 50000;
+            else next_report_ += 100000;
+            fprintf(stderr, "... finished %d ops%30s\r", done_, "");
+            fflush(stderr);
+        }
+    }
 
 public:
-    Stats() { Start(); }
+    Stats() : interval_ns_(0), arrivals_(0), reporter_(NULL) { Start(); }
+
+    void SetReporter(IntervalReporter *reporter) { reporter_ = reporter; }
+
+    // Issues ops at 'qps' per second from Start() on, with arrivals drawn
+    // from 'seed'
+    void SetTargetRate(double qps, uint32_t seed) {
+        interval_ns_ = qps > 0 ? 1e9 / qps : 0;
+        arrivals_ = Random(seed);
+    }
 
     void Start() {
         next_report_ = 100;
-        last_op_finish_ = start_;
         hist_.Clear();
         done_ = 0;
         bytes_ = 0;
@@ -204,6 +722,13 @@ public:
         message_.clear();
         // When set, stats from this thread won't be merged with others.
         exclude_from_merge_ = false;
+        for (int t = 0; t < kNumOpTypes; t++) {
+            op_hist_[t].Clear();
+        }
+        last_op_nanos_ = NowNanos();
+        next_send_ = last_op_nanos_;
+        interval_hist_.Clear();
+        interval_ = reporter_ != NULL ? reporter_->Current() : 0;
     }
 
     void Merge(const Stats &other) {
@@ -211,6 +736,9 @@ public:
             return;
 
         hist_.Merge(other.hist_);
+        for (int t = 0; t < kNumOpTypes; t++) {
+            op_hist_[t].Merge(other.op_hist_[t]);
+        }
         done_ += other.done_;
         bytes_ += other.bytes_;
         seconds_ += other.seconds_;
@@ -224,6 +752,10 @@ public:
     void Stop() {
         finish_ = g_env->NowMicros();
         seconds_ = (finish_ - start_) * 1e-6;
+        if (reporter_ != NULL) {
+            reporter_->Publish(interval_, interval_hist_);
+            interval_hist_.Clear();
+        }
     }
 
     void AddMessage(Slice msg) {
@@ -231,31 +763,43 @@ public:
     }
 
     void SetExcludeFromMerge() { exclude_from_merge_ = true; }
-
-    void FinishedSingleOp() {
+    bool ExcludedFromMerge() const { return exclude_from_merge_; }
+
+    int Ops() const { return done_; }
+    int64_t Bytes() const { return bytes_; }
+    // Time the ops took in this thread, summed over merged threads
+    double Seconds() const { return seconds_; }
+    // Wall-clock time from the first start to the last stop
+    double Elapsed() const { return (finish_ - start_) * 1e-6; }
+    const HdrHistogram &OpHistogram(int type) const { return op_hist_[type]; }
+
+    // Accounts the time since the previous op of this thread, or since its
+    // intended send time on an open-loop schedule, to 'type', so each op
+    // costs one timestamp.  A late op does not shift the schedule: the
+    // queueing delay it causes shows up in the latency of the ops after it.
+    void FinishedSingleOp(OperationType type) {
+        uint64_t now = NowNanos();
+        uint64_t nanos = now - last_op_nanos_;
+        last_op_nanos_ = interval_ns_ > 0 ? NextSend(now) : now;
+        op_hist_[type].Add(nanos);
+        if (reporter_ != NULL) {
+            interval_hist_.Add(nanos);
+            int k = reporter_->Current();
+            if (k != interval_) {
+                reporter_->Publish(interval_, interval_hist_);
+                interval_hist_.Clear();
+                interval_ = k;
+            }
+        }
         if (FLAGS_histogram) {
-            double now = g_env->NowMicros();
-            double micros = now - last_op_finish_;
+            double micros = nanos * 1e-3;
             hist_.Add(micros);
             if (micros > 20000) {
                 fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
                 fflush(stderr);
             }
-            last_op_finish_ = now;
-        }
-
-        done_++;
-        if (done_ >= next_report_) {
-            if (next_report_ < 1000) next_report_ += 100;
-            else if (next_report_ < 5000) next_report_ += 500;
-            else if (next_report_ < 10000) next_report_ += 1000;
-            else if (next_report_ < 50000) next_report_ += 5000;
-            else if (next_report_ < 100000) next_report_ += 10000;
-            else if (next_report_ < 500000) next_report_ += 50000;
-            else next_report_ += 100000;
-            fprintf(stderr, "... finished %d ops%30s\r", done_, "");
-            fflush(stderr);
         }
+        Done();
     }
 
     void AddBytes(int64_t n) {
@@ -285,6 +829,17 @@ public:
                 done_ / seconds_,
                 (extra.empty() ? "" : " "),
                 extra.c_str());
+        for (int t = 0; t < kNumOpTypes; t++) {
+            const HdrHistogram &h = op_hist_[t];
+            if (h.Count() == 0)
+                continue;
+            fprintf(stdout, "  %-10s : %11.3f micros/op %.0f ops/sec; p50 %.3f p90 %.3f "
+                    "p99 %.3f p99.9 %.3f p99.99 %.3f max %.3f micros\n",
+                    op_names[t], h.Average() * 1e-3, h.Count() / seconds_,
+                    h.Percentile(50) * 1e-3, h.Percentile(90) * 1e-3,
+                    h.Percentile(99) * 1e-3, h.Percentile(99.9) * 1e-3,
+                    h.Percentile(99.99) * 1e-3, h.Max() * 1e-3);
+        }
         if (FLAGS_histogram) {
             fprintf(stdout, "Microseconds per op:\n%s\n", hist_.ToString().c_str());
         }
@@ -320,7 +875,9 @@ struct ThreadState {
 
     ThreadState(int index)
             : tid(index),
-              rand(1000 + index) {
+              rand(FLAGS_seed + index) {
+        // arrivals have their own generator, so pacing leaves the keys as they are
+        stats.SetTargetRate(FLAGS_target_qps / FLAGS_threads, ~(uint32_t)(FLAGS_seed + index));
     }
 };
 
@@ -346,7 +903,8 @@ public:
             auto granularity = FLAGS_ops_between_duration_checks;
             if ((ops_ / granularity) != ((ops_ - increment) / granularity)) {
                 time_point now = std::chrono::high_resolution_clock::now();
-                return std::chrono::duration_cast<std::chrono::milliseconds>(now - start_at_).count() >= max_seconds_;
+                return std::chrono::duration_cast<std::chrono::milliseconds>(now - start_at_).count() >=
+                        (int64_t)max_seconds_ * 1000;
             } else {
                 return false;
             }
@@ -363,11 +921,50 @@ private:
     time_point start_at_;
 };
 
-class PMKVWrapper {
+// The store under test.  --engine=pmkv runs libpmkv; any other name is
+// opened as a pmemkv engine so both can run the same workloads.
+class KVWrapper {
+public:
+	virtual ~KVWrapper() {}
+
+	virtual status get(string_view key, std::string *value) = 0;
+	virtual status put(string_view key, string_view value) = 0;
+	virtual status remove(string_view key) = 0;
+	virtual status count_all(std::size_t &cnt) = 0;
+	virtual status exists(string_view key) = 0;
+
+	// Read 'key' into 'value', then write 'new_value' to it, as YCSB F does.
+	// Engines that can look the key up once for both override this.
+	virtual status read_modify_write(string_view key, std::string *value,
+			string_view new_value) {
+		status s = get(key, value);
+		put(key, new_value);
+		return s;
+	}
+
+	// pmkv extensions; other engines have none of them
+	virtual status stats(struct pmkv_stats *st) {
+		return status::NOT_SUPPORTED;
+	}
+
+	virtual uint64_t hash(string_view key) {
+		return 0;
+	}
+
+	virtual int nodes() {
+		return 1;
+	}
+
+	virtual status bind_thread(int node) {
+		return status::NOT_SUPPORTED;
+	}
+};
+
+class PMKVWrapper : public KVWrapper {
 public:
-	PMKVWrapper(std::string path, size_t size, bool create)
+	PMKVWrapper(std::string path, size_t size, bool create, const struct pmkv_options &opts)
 	{
-		_kv = pmkv_open(path.c_str(), size, create ? 1 : 0);
+		_kv = pmkv_open_opts(path.c_str(), size, create ? 1 : 0, &opts);
 		if (_kv == NULL)
 			throw std::runtime_error("Failed to open kv file");
 	}
@@ -377,7 +974,8 @@ public:
 		pmkv_close(_kv);
 	}
 
-	status get(string_view key, std::string *value) {
+	// Without an allocation once 'value' has grown to the largest value
+	status get(string_view key, std::string *value) override {
 		char val[MAX_VAL_LEN];
 		size_t val_size;
 		int s = pmkv_get(_kv, key.data(), key.size(), val, &val_size);
@@ -387,56 +985,270 @@ public:
 		return status::OK;
 	}
 
-	status put(string_view key, string_view value) {
+	status put(string_view key, string_view value) override {
 		int s = pmkv_put(_kv, key.data(), key.size(), value.data(), value.size());
 		if (s)
 			throw std::runtime_error("Failed to put with an undefined error");
 		return status::OK;
 	}
 
-	status remove(string_view key) {
+	// The key is hashed once for the get and the put
+	status read_modify_write(string_view key, std::string *value,
+			string_view new_value) override {
+		char val[MAX_VAL_LEN];
+		size_t val_size;
+		uint64_t h = pmkv_hash_key(_kv, key.data(), key.size());
+		status s = status::NOT_FOUND;
+		if (pmkv_get_hashed(_kv, h, key.data(), key.size(), val, &val_size) == 0) {
+			value->assign(val, val_size);
+			s = status::OK;
+		}
+		if (pmkv_put_hashed(_kv, h, key.data(), key.size(), new_value.data(), new_value.size()))
+			throw std::runtime_error("Failed to put with an undefined error");
+		return s;
+	}
+
+	status remove(string_view key) override {
 		int s = pmkv_delete(_kv, key.data(), key.size());
 		if (s)
 			return status::NOT_FOUND;
 		return status::OK;
 	}
 
-	status count_all(std::size_t &cnt) {
+	status count_all(std::size_t &cnt) override {
 		int s = pmkv_count_all(_kv, &cnt);
 		if (s)
 			throw std::runtime_error("Failed to count all with an undefined error");
 		return status::OK;
 	}
 
-	status exists(string_view key) {
+	status exists(string_view key) override {
 		if (!pmkv_exists(_kv, key.data(), key.size()))
 			return status::NOT_FOUND;
 		return status::OK;
 	}
 
+	status stats(struct pmkv_stats *st) override {
+		if (pmkv_get_stats(_kv, st))
+			return status::NOT_SUPPORTED;
+		return status::OK;
+	}
+
+	uint64_t hash(string_view key) override {
+		return pmkv_hash_key(_kv, key.data(), key.size());
+	}
+
+	int nodes() override {
+		return pmkv_nodes(_kv);
+	}
+
+	status bind_thread(int node) override {
+		if (pmkv_bind_thread(_kv, node))
+			return status::NOT_SUPPORTED;
+		return status::OK;
+	}
+
 private:
 	pmkv* _kv;
 };
 
+class PmemkvWrapper : public KVWrapper {
+public:
+	PmemkvWrapper(const std::string &engine, std::string path, size_t size, bool create)
+	{
+		pmem::kv::config cfg;
+		if (cfg.put_string("path", path) != status::OK ||
+		    cfg.put_uint64("size", size) != status::OK ||
+		    cfg.put_uint64("force_create", create ? 1 : 0) != status::OK)
+			throw std::runtime_error("Failed to configure pmemkv");
+		if (_db.open(engine, std::move(cfg)) != status::OK)
+			throw std::runtime_error("Failed to open pmemkv engine " + engine);
+	}
+
+	~PmemkvWrapper()
+	{
+		_db.close();
+	}
+
+	status get(string_view key, std::string *value) override {
+		return _db.get(key, value);
+	}
+
+	status put(string_view key, string_view value) override {
+		status s = _db.put(key, value);
+		if (s != status::OK)
+			throw std::runtime_error("Failed to put with an undefined error");
+		return s;
+	}
+
+	status remove(string_view key) override {
+		return _db.remove(key);
+	}
+
+	status count_all(std::size_t &cnt) override {
+		status s = _db.count_all(cnt);
+		if (s != status::OK)
+			throw std::runtime_error("Failed to count all with an undefined error");
+		return s;
+	}
+
+	status exists(string_view key) override {
+		return _db.exists(key);
+	}
+
+private:
+	pmem::kv::db _db;
+};
+
+// --engine=noop: every op succeeds without doing anything, so a run
+// measures what the harness itself costs per op
+class NoopWrapper : public KVWrapper {
+public:
+	status get(string_view key, std::string *value) override {
+		return status::OK;
+	}
+
+	status put(string_view key, string_view value) override {
+		return status::OK;
+	}
+
+	status remove(string_view key) override {
+		return status::OK;
+	}
+
+	status count_all(std::size_t &cnt) override {
+		cnt = 0;
+		return status::OK;
+	}
+
+	status exists(string_view key) override {
+		return status::NOT_FOUND;
+	}
+};
+
+// --engine=dram: a hash map in DRAM with pmkv's semantics, split into
+// locked shards so that threads can share it
+class DramWrapper : public KVWrapper {
+public:
+	status get(string_view key, std::string *value) override {
+		Shard &sh = shard(key);
+		MutexLock l(&sh.mu);
+		auto it = sh.map.find(_key);
+		if (it == sh.map.end())
+			return status::NOT_FOUND;
+		value->assign(it->second);
+		return status::OK;
+	}
+
+	status put(string_view key, string_view value) override {
+		Shard &sh = shard(key);
+		MutexLock l(&sh.mu);
+		sh.map[_key].assign(value.data(), value.size());
+		return status::OK;
+	}
+
+	status read_modify_write(string_view key, std::string *value,
+			string_view new_value) override {
+		Shard &sh = shard(key);
+		MutexLock l(&sh.mu);
+		auto it = sh.map.find(_key);
+		if (it == sh.map.end()) {
+			sh.map[_key].assign(new_value.data(), new_value.size());
+			return status::NOT_FOUND;
+		}
+		value->assign(it->second);
+		it->second.assign(new_value.data(), new_value.size());
+		return status::OK;
+	}
+
+	status remove(string_view key) override {
+		Shard &sh = shard(key);
+		MutexLock l(&sh.mu);
+		return sh.map.erase(_key) ? status::OK : status::NOT_FOUND;
+	}
+
+	status count_all(std::size_t &cnt) override {
+		cnt = 0;
+		for (int i = 0; i < kShards; i++) {
+			MutexLock l(&_shards[i].mu);
+			cnt += _shards[i].map.size();
+		}
+		return status::OK;
+	}
+
+	status exists(string_view key) override {
+		Shard &sh = shard(key);
+		MutexLock l(&sh.mu);
+		return sh.map.count(_key) ? status::OK : status::NOT_FOUND;
+	}
+
+private:
+	enum { kShards = 64 };
+
+	struct Shard {
+		port::Mutex mu;
+		std::unordered_map<std::string, std::string> map;
+	};
+
+	Shard _shards[kShards];
+	// lookups copy the key here, which stops allocating after the first op
+	static thread_local std::string _key;
+
+	Shard &shard(string_view key) {
+		_key.assign(key.data(), key.size());
+		return _shards[std::hash<std::string>()(_key) % kShards];
+	}
+};
+
+thread_local std::string DramWrapper::_key;
+
 class Benchmark {
 private:
-    PMKVWrapper *kv_;
+    KVWrapper *kv_;
+    std::unique_ptr<ZipfianGenerator> zipf_;
     int num_;
     int value_size_;
     int key_size_;
     int reads_;
     int64_t readwrites_;
+    size_t numa_local_;
+    size_t numa_remote_;
+    const YcsbWorkload *ycsb_;
+    std::unique_ptr<ZipfianGenerator> ycsb_zipf_;
+    std::atomic<int64_t> ycsb_count_;   // records inserted so far
+    FILE *results_;                     // --output_file, NULL for text output only
+    int num_results_;
+    KVWrapper *baseline_[2];            // noop and dram engines of --calibrate
 
     void PrintHeader() {
         PrintEnvironment();
         fprintf(stdout, "Path:       %s\n", FLAGS_db);
         fprintf(stdout, "Engine:     %s\n", FLAGS_engine);
-        fprintf(stdout, "Keys:       %d bytes each\n", FLAGS_key_size);
+        fprintf(stdout, "Keys:       %d bytes each%s\n", FLAGS_key_size,
+                FLAGS_fixed_key ? " (fixed)" : "");
         fprintf(stdout, "Values:     %d bytes each\n", FLAGS_value_size);
         fprintf(stdout, "Entries:    %d\n", num_);
+        fprintf(stdout, "KeyDist:    %s (zipf theta %.2f, seed %d)\n",
+                FLAGS_key_dist >= 0 ? key_dist_names[FLAGS_key_dist] : "uniform",
+                FLAGS_zipf_theta, FLAGS_seed);
         fprintf(stdout, "RawSize:    %.1f MB (estimated)\n",
                 ((static_cast<int64_t>(FLAGS_key_size + FLAGS_value_size) * num_)
                  / 1048576.0));
+        fprintf(stdout, "Pool:       %d GB, %d raw bytes/key\n", FLAGS_db_size_in_gb,
+                FLAGS_key_size + FLAGS_value_size);
+        if (g_tsc_nanos > 0)
+            fprintf(stdout, "Timer:      rdtscp at %.3f GHz, %.1f ns per reading\n",
+                    1 / g_tsc_nanos, g_timer_overhead);
+        else
+            fprintf(stdout, "Timer:      clock_gettime(CLOCK_MONOTONIC_RAW), %.1f ns per reading\n",
+                    g_timer_overhead);
+        if (FLAGS_target_qps > 0)
+            fprintf(stdout, "Load:       open loop, %.0f ops/sec, %s arrivals\n",
+                    FLAGS_target_qps, FLAGS_poisson ? "poisson" : "constant");
+        else
+            fprintf(stdout, "Load:       closed loop\n");
+        fprintf(stdout, "Compression: %s from %d bytes, values compress to %.2f\n",
+                codec_names[FLAGS_codec], FLAGS_compress_min, FLAGS_compression_ratio);
         PrintWarnings();
         fprintf(stdout, "------------------------------------------------\n");
     }
@@ -458,27 +1270,11 @@ private:
         time_t now = time(NULL);
         fprintf(stdout, "Date:       %s", ctime(&now));  // ctime() adds newline
 
-        FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
-        if (cpuinfo != NULL) {
-            char line[1000];
-            int num_cpus = 0;
-            std::string cpu_type;
-            std::string cache_size;
-            while (fgets(line, sizeof(line), cpuinfo) != NULL) {
-                const char *sep = strchr(line, ':');
-                if (sep == NULL) {
-                    continue;
-                }
-                Slice key = TrimSpace(Slice(line, sep - 1 - line));
-                Slice val = TrimSpace(Slice(sep + 1));
-                if (key == "model name") {
-                    ++num_cpus;
-                    cpu_type = val.ToString();
-                } else if (key == "cache size") {
-                    cache_size = val.ToString();
-                }
-            }
-            fclose(cpuinfo);
+        int num_cpus;
+        std::string cpu_type;
+        std::string cache_size;
+        ReadCpuInfo(&num_cpus, &cpu_type, &cache_size);
+        if (num_cpus > 0) {
             fprintf(stdout, "CPU:        %d * %s\n", num_cpus, cpu_type.c_str());
             fprintf(stdout, "CPUCache:   %s\n", cache_size.c_str());
         }
@@ -493,15 +1289,25 @@ public:
             value_size_(FLAGS_value_size),
             key_size_(FLAGS_key_size),
             reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-            readwrites_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads) {
+            readwrites_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
+            numa_local_(0),
+            numa_remote_(0),
+            ycsb_(NULL),
+            ycsb_count_(FLAGS_ycsb_records),
+            results_(NULL),
+            num_results_(0),
+            baseline_() {
     }
 
     ~Benchmark() {
         delete kv_;
+        delete baseline_[0];
+        delete baseline_[1];
     }
 
+    // One byte more than a key, for the suffix of readmissing
     Slice AllocateKey(std::unique_ptr<const char[]>& key_guard) {
-        const char* tmp = new char[key_size_];
+        const char* tmp = new char[key_size_ + 1];
         key_guard.reset(tmp);
         return Slice(key_guard.get(), key_size_);
     }
@@ -520,6 +1326,10 @@ public:
 
     void Run() {
         PrintHeader();
+        OpenResults();
+        if (KeyDistZipfian(FLAGS_key_dist)) {
+            zipf_.reset(new ZipfianGenerator(FLAGS_num, FLAGS_zipf_theta));
+        }
 
         const char *benchmarks = FLAGS_benchmarks;
         while (benchmarks != NULL) {
@@ -557,6 +1367,13 @@ public:
                 method = &Benchmark::ReadRandom;
             } else if (name == Slice("readmissing")) {
                 method = &Benchmark::ReadMissing;
+            } else if (name == Slice("hashkeys")) {
+                method = &Benchmark::HashKeys;
+            } else if (name == Slice("readzipfian")) {
+                if (!zipf_) {
+                    zipf_.reset(new ZipfianGenerator(FLAGS_num, FLAGS_zipf_theta));
+                }
+                method = &Benchmark::ReadZipfian;
             } else if (name == Slice("deleteseq")) {
                 method = &Benchmark::DeleteSeq;
             } else if (name == Slice("deleterandom")) {
@@ -566,6 +1383,19 @@ public:
                 method = &Benchmark::ReadWhileWriting;
             } else if (name == Slice("readrandomwriterandom")) {
                 method = &Benchmark::ReadRandomWriteRandom;
+            } else if (name == Slice("sustainedoverwrite")) {
+                method = &Benchmark::SustainedOverwrite;
+            } else if (name == Slice("ycsbload")) {
+                fresh_db = true;
+                ycsb_count_ = FLAGS_ycsb_records;
+                method = &Benchmark::YcsbLoad;
+            } else if (name.size() == 5 && name.starts_with("ycsb") &&
+                       name[4] >= 'a' && name[4] <= 'f') {
+                ycsb_ = &ycsb_workloads[name[4] - 'a'];
+                if (!ycsb_zipf_ && KeyDistZipfian(FLAGS_key_dist >= 0 ? FLAGS_key_dist : ycsb_->dist)) {
+                    ycsb_zipf_.reset(new ZipfianGenerator(FLAGS_ycsb_records, FLAGS_zipf_theta));
+                }
+                method = &Benchmark::Ycsb;
             } else {
                 if (name != Slice()) {  // No error message for empty name
                     fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -579,7 +1409,9 @@ public:
                 }
                 if (FLAGS_db_size_in_gb > 0) {
                     auto start = g_env->NowMicros();
-                    std::remove(FLAGS_db);
+                    for (const std::string &path : DbPaths()) {
+                        std::remove(path.c_str());
+                    }
                     fprintf(stdout, "%-12s : %11.3f millis/op;\n", "removed", ((g_env->NowMicros() - start) * 1e-3));
                 }
             }
@@ -589,9 +1421,27 @@ public:
             }
 
             if (method != NULL) {
-                RunBenchmark(num_threads, name, method);
+                double micros = RunBenchmark(num_threads, name, method);
+                PrintFootprintStats();
+                if (FLAGS_numa) {
+                    PrintNumaStats();
+                }
+                if (FLAGS_codec != PMKV_CODEC_NONE) {
+                    PrintCompressionStats();
+                }
+                if (method == &Benchmark::SustainedOverwrite) {
+                    PrintCompactionStats();
+                } else if (method == &Benchmark::ReadMissing) {
+                    PrintFilterStats();
+                } else if (method == &Benchmark::ReadZipfian) {
+                    PrintCacheStats();
+                }
+                if (FLAGS_calibrate) {
+                    Calibrate(num_threads, name, method, fresh_db, micros);
+                }
             }
         }
+        CloseResults();
     }
 
 private:
@@ -607,6 +1457,12 @@ private:
         ThreadArg *arg = reinterpret_cast<ThreadArg *>(v);
         SharedState *shared = arg->shared;
         ThreadState *thread = arg->thread;
+        if (FLAGS_numa) {
+            KVWrapper *kv = arg->bm->kv_;
+            if (kv->bind_thread(thread->tid % kv->nodes()) != pmem::kv::status::OK)
+                fprintf(stderr, "thread %d: cannot bind to node %d\n", thread->tid,
+                        thread->tid % kv->nodes());
+        }
         {
             MutexLock l(&shared->mu);
             shared->num_initialized++;
@@ -631,14 +1487,167 @@ private:
         }
     }
 
-    void RunBenchmark(int n, Slice name,
-                      void (Benchmark::*method)(ThreadState *)) {
+    void OpenResults() {
+        if (FLAGS_output_format == kText)
+            return;
+        std::string path = FLAGS_output_file != NULL ? FLAGS_output_file :
+                std::string("bench.") + output_format_names[FLAGS_output_format];
+        results_ = fopen(path.c_str(), "w");
+        if (results_ == NULL) {
+            fprintf(stderr, "Cannot open %s: %s\n", path.c_str(), strerror(errno));
+            exit(1);
+        }
+        num_results_ = 0;
+        if (FLAGS_output_format == kCsv) {
+            fprintf(results_, "revision,engine,key_size,value_size,threads,benchmark,"
+                    "thread,op,ops,seconds,ops_per_sec,mb_per_sec,avg_us,p50_us,"
+                    "p90_us,p99_us,p99.9_us,p99.99_us,max_us\n");
+            return;
+        }
+
+        int num_cpus = 0;
+        std::string cpu_type, cache_size;
+#if defined(__linux)
+        ReadCpuInfo(&num_cpus, &cpu_type, &cache_size);
+#endif
+        time_t now = time(NULL);
+        char date[64];
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+        fprintf(results_, "{\n");
+        fprintf(results_, "  \"revision\": %s,\n", JsonString(BENCH_GIT_REV).c_str());
+        fprintf(results_, "  \"date\": \"%s\",\n", date);
+        fprintf(results_, "  \"cpu\": %s,\n", JsonString(cpu_type).c_str());
+        fprintf(results_, "  \"cpus\": %d,\n", num_cpus);
+        fprintf(results_, "  \"cpu_cache\": %s,\n", JsonString(cache_size).c_str());
+        fprintf(results_, "  \"timer\": \"%s\",\n", g_tsc_nanos > 0 ? "rdtscp" : "clock_gettime");
+        fprintf(results_, "  \"timer_overhead_ns\": %.1f,\n", g_timer_overhead);
+        fprintf(results_, "  \"engine\": %s,\n", JsonString(FLAGS_engine).c_str());
+        fprintf(results_, "  \"db\": %s,\n", JsonString(FLAGS_db).c_str());
+        fprintf(results_, "  \"db_size_in_gb\": %d,\n", FLAGS_db_size_in_gb);
+        fprintf(results_, "  \"key_size\": %d,\n", FLAGS_key_size);
+        fprintf(results_, "  \"value_size\": %d,\n", FLAGS_value_size);
+        fprintf(results_, "  \"entries\": %d,\n", FLAGS_num);
+        fprintf(results_, "  \"threads\": %d,\n", FLAGS_threads);
+        fprintf(results_, "  \"key_dist\": \"%s\",\n",
+                FLAGS_key_dist >= 0 ? key_dist_names[FLAGS_key_dist] : "uniform");
+        fprintf(results_, "  \"compression\": \"%s\",\n", codec_names[FLAGS_codec]);
+        fprintf(results_, "  \"target_qps\": %.1f,\n", FLAGS_target_qps);
+        fprintf(results_, "  \"arrival\": \"%s\",\n", FLAGS_target_qps <= 0 ? "closed" :
+                FLAGS_poisson ? "poisson" : "constant");
+        fprintf(results_, "  \"benchmarks\": [");
+    }
+
+    void CloseResults() {
+        if (results_ == NULL)
+            return;
+        if (FLAGS_output_format == kJson)
+            fprintf(results_, "%s]\n}\n", num_results_ > 0 ? "\n  " : "");
+        fclose(results_);
+        results_ = NULL;
+    }
+
+    // One json object of s, with rates over 'seconds'
+    std::string StatsJson(const Stats &s, double seconds) {
+        char buf[512];
+        snprintf(buf, sizeof(buf), "{\"ops\": %d, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+                 "\"mb_per_sec\": %.3f, \"latency_us\": {", s.Ops(), seconds,
+                 s.Ops() / seconds, s.Bytes() / 1048576.0 / seconds);
+        std::string r = buf;
+        const char *sep = "";
+        for (int t = 0; t < kNumOpTypes; t++) {
+            const HdrHistogram &h = s.OpHistogram(t);
+            if (h.Count() == 0)
+                continue;
+            snprintf(buf, sizeof(buf), "%s\"%s\": {\"ops\": %" PRIu64 ", \"avg\": %.3f, "
+                     "\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p99.9\": %.3f, "
+                     "\"p99.99\": %.3f, \"max\": %.3f}", sep, op_names[t], h.Count(),
+                     h.Average() * 1e-3, h.Percentile(50) * 1e-3, h.Percentile(90) * 1e-3,
+                     h.Percentile(99) * 1e-3, h.Percentile(99.9) * 1e-3,
+                     h.Percentile(99.99) * 1e-3, h.Max() * 1e-3);
+            r.append(buf);
+            sep = ", ";
+        }
+        r.append("}}");
+        return r;
+    }
+
+    // Summary row of s, then a row per operation type
+    void StatsCsv(const Slice &name, const std::string &thread, const Stats &s,
+                  double seconds, int threads) {
+        std::string prefix = std::string(BENCH_GIT_REV) + "," + FLAGS_engine;
+        fprintf(results_, "%s,%d,%d,%d,%s,%s,all,%d,%.6f,%.1f,%.3f,,,,,,,\n",
+                prefix.c_str(), FLAGS_key_size, FLAGS_value_size, threads,
+                name.ToString().c_str(), thread.c_str(), s.Ops(), seconds,
+                s.Ops() / seconds, s.Bytes() / 1048576.0 / seconds);
+        for (int t = 0; t < kNumOpTypes; t++) {
+            const HdrHistogram &h = s.OpHistogram(t);
+            if (h.Count() == 0)
+                continue;
+            fprintf(results_, "%s,%d,%d,%d,%s,%s,%s,%" PRIu64 ",%.6f,%.1f,,"
+                    "%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                    prefix.c_str(), FLAGS_key_size, FLAGS_value_size, threads,
+                    name.ToString().c_str(), thread.c_str(), op_names[t], h.Count(),
+                    seconds, h.Count() / seconds, h.Average() * 1e-3,
+                    h.Percentile(50) * 1e-3, h.Percentile(90) * 1e-3,
+                    h.Percentile(99) * 1e-3, h.Percentile(99.9) * 1e-3,
+                    h.Percentile(99.99) * 1e-3, h.Max() * 1e-3);
+        }
+    }
+
+    // Each thread's stats over its own run time, and the merged stats over
+    // the wall-clock time of the benchmark
+    void WriteResult(const Slice &name, ThreadArg *arg, int n) {
+        Stats total;
+        bool merged = false;
+        for (int i = 0; i < n; i++) {
+            const Stats &s = arg[i].thread->stats;
+            if (s.ExcludedFromMerge())
+                continue;
+            if (merged) {
+                total.Merge(s);
+            } else {
+                total = s;
+                merged = true;
+            }
+        }
+        double elapsed = std::max(total.Elapsed(), 1e-9);
+
+        if (FLAGS_output_format == kCsv) {
+            for (int i = 0; i < n; i++) {
+                const Stats &s = arg[i].thread->stats;
+                StatsCsv(name, std::to_string(i), s, std::max(s.Seconds(), 1e-9), n);
+            }
+            StatsCsv(name, "all", total, elapsed, n);
+            fflush(results_);
+            return;
+        }
+        fprintf(results_, "%s\n    {\"name\": %s, \"threads\": [", num_results_ > 0 ? "," : "",
+                JsonString(name.ToString()).c_str());
+        for (int i = 0; i < n; i++) {
+            const Stats &s = arg[i].thread->stats;
+            fprintf(results_, "%s\n      %s", i > 0 ? "," : "",
+                    StatsJson(s, std::max(s.Seconds(), 1e-9)).c_str());
+        }
+        fprintf(results_, "\n    ],\n    \"aggregate\": %s}", StatsJson(total, elapsed).c_str());
+        fflush(results_);
+        num_results_++;
+    }
+
+    // Returns the time per op of the threads whose stats merge; 'report'
+    // prints and records the results
+    double RunBenchmark(int n, Slice name,
+                        void (Benchmark::*method)(ThreadState *), bool report = true) {
         SharedState shared;
         shared.total = n;
         shared.num_initialized = 0;
         shared.num_done = 0;
         shared.start = false;
 
+        std::unique_ptr<IntervalReporter> reporter;
+        if (report && FLAGS_report_interval > 0) {
+            reporter.reset(new IntervalReporter(FLAGS_report_interval));
+        }
+
         ThreadArg *arg = new ThreadArg[n];
         for (int i = 0; i < n; i++) {
             arg[i].bm = this;
@@ -646,6 +1655,7 @@ private:
             arg[i].shared = &shared;
             arg[i].thread = new ThreadState(i);
             arg[i].thread->shared = &shared;
+            arg[i].thread->stats.SetReporter(reporter.get());
             g_env->StartThread(ThreadBody, &arg[i]);
         }
 
@@ -655,20 +1665,62 @@ private:
         }
 
         shared.start = true;
+        if (reporter) {
+            reporter->Start();
+        }
         shared.cv.SignalAll();
         while (shared.num_done < n) {
             shared.cv.Wait();
         }
         shared.mu.Unlock();
+        if (reporter) {
+            reporter->Stop();
+        }
 
-        for (int i = 0; i < n; i++) {
-            arg[i].thread->stats.Report(name);
+        if (report) {
+            for (int i = 0; i < n; i++) {
+                arg[i].thread->stats.Report(name);
+            }
+            if (results_ != NULL) {
+                WriteResult(name, arg, n);
+            }
         }
 
+        double seconds = 0;
+        int64_t ops = 0;
         for (int i = 0; i < n; i++) {
+            const Stats &s = arg[i].thread->stats;
+            if (!s.ExcludedFromMerge()) {
+                seconds += s.Seconds();
+                ops += s.Ops();
+            }
             delete arg[i].thread;
         }
         delete[] arg;
+        return ops > 0 ? seconds * 1e6 / ops : 0;
+    }
+
+    // Runs the benchmark again on the noop and dram engines, which keep
+    // their own contents across benchmarks, and compares the time per op
+    void Calibrate(int n, Slice name, void (Benchmark::*method)(ThreadState *),
+                   bool fresh_db, double micros) {
+        double base[2];
+        int64_t ycsb_count = ycsb_count_;
+        for (int b = 0; b < 2; b++) {
+            if (fresh_db || baseline_[b] == NULL) {
+                delete baseline_[b];
+                baseline_[b] = b == 0 ? (KVWrapper *)new NoopWrapper() : new DramWrapper();
+            }
+            std::swap(kv_, baseline_[b]);
+            base[b] = RunBenchmark(n, name, method, false);
+            std::swap(kv_, baseline_[b]);
+            ycsb_count_ = ycsb_count;
+        }
+        fprintf(stdout, "%-12s : noop %.3f, dram %.3f, %s %.3f micros/op; "
+                "%.3f over dram (%.2fx), %.3f over the harness\n", "calibration",
+                base[0], base[1], FLAGS_engine, micros, micros - base[1],
+                base[1] > 0 ? micros / base[1] : 0, micros - base[0]);
+        fflush(stdout);
     }
 
 	void Open(bool fresh_db) {
@@ -676,39 +1728,89 @@ private:
 		auto start = g_env->NowMicros();
 		auto size = 1024ULL * 1024ULL * 1024ULL * FLAGS_db_size_in_gb;
 		std::string path(FLAGS_db);
-		if (fresh_db)
-			std::remove(FLAGS_db);
-		kv_ = new PMKVWrapper(path, size, fresh_db);
-		if (!kv_) {
+		std::vector<std::string> node_paths = DbPaths();
+		if (fresh_db) {
+			for (const std::string &p : node_paths)
+				std::remove(p.c_str());
+		}
+		numa_local_ = numa_remote_ = 0;
+		struct pmkv_options opts;
+		memset(&opts, 0, sizeof(opts));
+		opts.cache_bytes = (size_t)FLAGS_cache_mb << 20;
+		opts.hash = FLAGS_hash;
+		opts.key_size = FLAGS_fixed_key ? FLAGS_key_size : 0;
+		opts.grow_bytes = (size_t)FLAGS_grow_in_gb << 30;
+		opts.codec = FLAGS_codec;
+		opts.compress_min = FLAGS_compress_min;
+		if (node_paths.size() > PMKV_MAX_NODES) {
+			fprintf(stderr, "--db lists more than %d pools\n", PMKV_MAX_NODES);
+			exit(1);
+		}
+		if (node_paths.size() > 1) {
+			for (size_t i = 0; i < node_paths.size(); i++)
+				opts.node_paths[i] = node_paths[i].c_str();
+			opts.nodes = node_paths.size();
+		}
+		try {
+			if (strcmp(FLAGS_engine, "pmkv") == 0)
+				kv_ = new PMKVWrapper(path, size, fresh_db, opts);
+			else if (strcmp(FLAGS_engine, "noop") == 0)
+				kv_ = new NoopWrapper();
+			else if (strcmp(FLAGS_engine, "dram") == 0)
+				kv_ = new DramWrapper();
+			else
+				kv_ = new PmemkvWrapper(FLAGS_engine, path, size, fresh_db);
+		} catch (std::runtime_error &e) {
 			fprintf(stderr,
-				"Cannot start pmkv for path (%s) with %i GB capacity\n%s\n\nUSAGE: %s",
-				FLAGS_db, FLAGS_db_size_in_gb, pmem::kv::errormsg().c_str(),
-				USAGE.c_str());
+				"Cannot start %s for path (%s) with %i GB capacity\n%s\n%s\n\nUSAGE: %s",
+				FLAGS_engine, FLAGS_db, FLAGS_db_size_in_gb, e.what(),
+				pmem::kv::errormsg().c_str(), USAGE.c_str());
 			exit(-42);
 		}
+		// A reopened pool keeps the key layout it was created with
+		struct pmkv_stats st;
+		memset(&st, 0, sizeof(st));
+		if (kv_->stats(&st) == status::OK && st.key_size != 0 &&
+		    st.key_size != (size_t)FLAGS_key_size) {
+			fprintf(stderr, "%s holds fixed %zu-byte keys, run with --key_size=%zu\n",
+				FLAGS_db, st.key_size, st.key_size);
+			exit(1);
+		}
 
 		fprintf(stdout, "%-12s : %11.3f millis/op;\n", "open", ((g_env->NowMicros() - start) * 1e-3));
 	}
 
+    KeyGenerator RandomKeys(ThreadState *thread) {
+        return KeyGenerator(FLAGS_key_dist >= 0 ? FLAGS_key_dist : kUniform, &thread->rand,
+                            zipf_.get(), (int64_t)thread->tid * num_);
+    }
+
     void DoWrite(ThreadState *thread, bool seq) {
         if (num_ != FLAGS_num) {
             char msg[100];
             snprintf(msg, sizeof(msg), "(%d ops)", num_);
             thread->stats.AddMessage(msg);
         }
+        // constant bytes, unless the engine compresses: then values are as
+        // compressible as --compression_ratio says
+        std::unique_ptr<RandomGenerator> gen;
+        if (FLAGS_codec != PMKV_CODEC_NONE)
+            gen.reset(new RandomGenerator());
+        const std::string fill(value_size_, 'X');
+        KeyGenerator keys = RandomKeys(thread);
         std::unique_ptr<const char[]> key_guard;
         Slice key = AllocateKey(key_guard);
 
         pmem::kv::status s;
         int64_t bytes = 0;
-        for (int i = 0; i < num_; i++) {
-            const int k = seq ? (i + thread->tid * num_) : (thread->rand.Next() % FLAGS_num);
+        Duration duration(FLAGS_duration, num_);
+        for (int i = 0; !duration.Done(1); i++) {
+            const int k = seq ? (i % num_ + thread->tid * num_) : keys.Next(FLAGS_num);
             GenerateKeyFromInt(k, FLAGS_num, &key);
-            std::string value = std::string();
-            value.append(value_size_, 'X');
-            s = kv_->put(key.ToString(), value);
+            Slice value = gen ? gen->Generate(value_size_) : Slice(fill);
+            s = kv_->put(AsView(key), AsView(value));
             bytes += value_size_ + key.size();
-            thread->stats.FinishedSingleOp();
+            thread->stats.FinishedSingleOp(kWrite);
             if (s != pmem::kv::status::OK) {
                 fprintf(stdout, "Out of space at key %i\n", i);
                 exit(1);
@@ -729,19 +1831,30 @@ private:
         pmem::kv::status s;
         int64_t bytes = 0;
         int found = 0;
+        std::string value;
+        KeyGenerator keys = RandomKeys(thread);
         std::unique_ptr<const char[]> key_guard;
         Slice key = AllocateKey(key_guard);
-        for (int i = 0; i < reads_; i++) {
-            const int k = seq ? (i + thread->tid * num_) : (thread->rand.Next() % FLAGS_num);
+        Duration duration(FLAGS_duration, reads_);
+        int i;
+        for (i = 0; !duration.Done(1); i++) {
+            const int k = seq ? (i % num_ + thread->tid * num_) : keys.Next(FLAGS_num);
             GenerateKeyFromInt(k, FLAGS_num, &key);
-            std::string value;
-            if (kv_->get(key.ToString(), &value) == pmem::kv::status::OK) found++;
-            thread->stats.FinishedSingleOp();
-            bytes += value.length() + key.size();
+            string_view kview(key.data(), key.size());
+            if (missing) {
+                const_cast<char *>(key.data())[key.size()] = '.';
+                kview = string_view(key.data(), key.size() + 1);
+            }
+            if (kv_->get(kview, &value) == pmem::kv::status::OK) {
+                found++;
+                bytes += value.length();
+            }
+            thread->stats.FinishedSingleOp(kRead);
+            bytes += key.size();
         }
         thread->stats.AddBytes(bytes);
         char msg[100];
-        snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+        snprintf(msg, sizeof(msg), "(%d of %d found)", found, i);
         thread->stats.AddMessage(msg);
     }
 
@@ -757,14 +1870,40 @@ private:
         DoRead(thread, false, true);
     }
 
+    void ReadZipfian(ThreadState *thread) {
+        int64_t bytes = 0;
+        int found = 0;
+        std::string value;
+        std::unique_ptr<const char[]> key_guard;
+        Slice key = AllocateKey(key_guard);
+        Duration duration(FLAGS_duration, reads_);
+        int i;
+        for (i = 0; !duration.Done(1); i++) {
+            const int k = (int)zipf_->Next(thread->rand);
+            GenerateKeyFromInt(k, FLAGS_num, &key);
+            if (kv_->get(AsView(key), &value) == pmem::kv::status::OK) {
+                found++;
+                bytes += value.length();
+            }
+            thread->stats.FinishedSingleOp(kRead);
+            bytes += key.size();
+        }
+        thread->stats.AddBytes(bytes);
+        char msg[100];
+        snprintf(msg, sizeof(msg), "(%d of %d found)", found, i);
+        thread->stats.AddMessage(msg);
+    }
+
     void DoDelete(ThreadState *thread, bool seq) {
+        KeyGenerator keys = RandomKeys(thread);
         std::unique_ptr<const char[]> key_guard;
         Slice key = AllocateKey(key_guard);
-        for (int i = 0; i < num_; i++) {
-            const int k = seq ? (i + thread->tid * num_) : (thread->rand.Next() % FLAGS_num);
+        Duration duration(FLAGS_duration, num_);
+        for (int i = 0; !duration.Done(1); i++) {
+            const int k = seq ? (i % num_ + thread->tid * num_) : keys.Next(FLAGS_num);
             GenerateKeyFromInt(k, FLAGS_num, &key);
-            kv_->remove(key.ToString());
-            thread->stats.FinishedSingleOp();
+            kv_->remove(AsView(key));
+            thread->stats.FinishedSingleOp(kDelete);
         }
     }
 
@@ -783,6 +1922,7 @@ private:
 
         // Don't merge stats from this thread with the readers.
         thread->stats.SetExcludeFromMerge();
+        KeyGenerator keys = RandomKeys(thread);
 
         std::unique_ptr<const char[]> key_guard;
         Slice key = AllocateKey(key_guard);
@@ -799,11 +1939,11 @@ private:
                 }
             }
 
-            GenerateKeyFromInt(thread->rand.Next() % FLAGS_num, FLAGS_num, &key);
+            GenerateKeyFromInt(keys.Next(FLAGS_num), FLAGS_num, &key);
             pmem::kv::status s;
 
             if (write_merge == kWrite) {
-                s = kv_->put(key.ToString(), gen.Generate(value_size_).ToString());
+                s = kv_->put(AsView(key), AsView(gen.Generate(value_size_)));
             } else {
                 fprintf(stderr, "Merge operation not supported\n");
                 exit(1);
@@ -819,6 +1959,153 @@ private:
         thread->stats.AddBytes(bytes);
     }
 
+    void SustainedOverwrite(ThreadState *thread) {
+        // Every write picks a new value size around value_size_, so none of
+        // them can be done in place and the engine has to reclaim the space
+        // of the records it replaces to keep going.
+        RandomGenerator gen;
+        KeyGenerator keys = RandomKeys(thread);
+        std::unique_ptr<const char[]> key_guard;
+        Slice key = AllocateKey(key_guard);
+        int64_t pool_bytes = 1024LL * 1024LL * 1024LL * FLAGS_db_size_in_gb;
+        int64_t target = pool_bytes * FLAGS_pool_passes / FLAGS_threads;
+        int64_t bytes = 0;
+        int64_t ops = 0;
+        Duration duration(FLAGS_duration, INT64_MAX);
+
+        // --duration replaces the --pool_passes target
+        while (!duration.Done(1) && (FLAGS_duration > 0 || bytes < target)) {
+            GenerateKeyFromInt(keys.Next(FLAGS_num), FLAGS_num, &key);
+            int size = value_size_ / 2 + thread->rand.Uniform(value_size_ + 1);
+            pmem::kv::status s = kv_->put(AsView(key), AsView(gen.Generate(size)));
+            if (s != pmem::kv::status::OK) {
+                fprintf(stdout, "Out of space after %.1f MB\n", bytes / 1048576.0);
+                exit(1);
+            }
+            bytes += key.size() + size;
+            ops++;
+            thread->stats.FinishedSingleOp(kWrite);
+        }
+        thread->stats.AddBytes(bytes);
+        char msg[100];
+        snprintf(msg, sizeof(msg), "(%" PRId64 " ops)", ops);
+        thread->stats.AddMessage(msg);
+    }
+
+    void PrintCompactionStats() {
+        struct pmkv_stats st;
+        if (kv_->stats(&st) != pmem::kv::status::OK)
+            return;
+        fprintf(stdout, "%-12s : %.1f MB in %zu chunks, %.1f MB live\n", "log",
+                st.log_bytes / 1048576.0, st.log_chunks, st.live_bytes / 1048576.0);
+        fprintf(stdout, "%-12s : %zu chunks emptied, %.1f MB moved, %zu chunks reclaimed\n",
+                "compaction", st.compacted_chunks, st.compacted_bytes / 1048576.0,
+                st.reclaimed_chunks);
+        fflush(stdout);
+    }
+
+    void HashKeys(ThreadState *thread) {
+        // keys are generated up front so that only hashing is timed
+        const int nkeys = 1024;
+        std::vector<std::string> keys;
+        std::unique_ptr<const char[]> key_guard;
+        Slice key = AllocateKey(key_guard);
+        for (int i = 0; i < nkeys; i++) {
+            GenerateKeyFromInt(thread->rand.Next() % FLAGS_num, FLAGS_num, &key);
+            keys.push_back(key.ToString());
+        }
+        uint64_t sink = 0;
+        Duration duration(FLAGS_duration, reads_);
+        int64_t i;
+        for (i = 0; !duration.Done(1); i++) {
+            sink += kv_->hash(keys[i % nkeys]);
+            thread->stats.FinishedSingleOp(kOthers);
+        }
+        thread->stats.AddBytes(i * key_size_);
+        struct pmkv_stats st;
+        const char *kernel = "n/a";
+        if (kv_->stats(&st) == pmem::kv::status::OK)
+            kernel = st.hash < 4 ? hash_names[st.hash] : "?";
+        char msg[100];
+        snprintf(msg, sizeof(msg), "(%s, %d-byte keys, %016" PRIx64 ")",
+                 kernel, key_size_, sink);
+        thread->stats.AddMessage(msg);
+    }
+
+    void PrintCacheStats() {
+        struct pmkv_stats st;
+        if (kv_->stats(&st) != pmem::kv::status::OK || FLAGS_cache_mb == 0)
+            return;
+        size_t lookups = st.cache_hits + st.cache_misses;
+        fprintf(stdout, "%-12s : %.1f MB cached, %.2f%% hit rate\n", "cache",
+                st.cache_bytes / 1048576.0, lookups ? st.cache_hits * 100.0 / lookups : 0.0);
+        fflush(stdout);
+    }
+
+    void PrintCompressionStats() {
+        struct pmkv_stats st;
+        if (kv_->stats(&st) != pmem::kv::status::OK)
+            return;
+        fprintf(stdout, "%-12s : %zu values compressed, %.1f MB saved, %.1f MB live\n",
+                "compression", st.compressed_puts, st.compressed_saved / 1048576.0,
+                st.live_bytes / 1048576.0);
+        fflush(stdout);
+    }
+
+    void PrintFootprintStats() {
+        struct pmkv_stats st;
+        if (kv_->stats(&st) != pmem::kv::status::OK)
+            return;
+        size_t keys = st.live_keys > 0 ? st.live_keys : 1;
+        fprintf(stdout, "%-12s : %.1f bytes/key PM, %.1f bytes/key DRAM over %zu keys\n",
+                "footprint", (double)st.allocated_bytes / keys,
+                (double)st.dram_index_bytes / keys, st.live_keys);
+        fprintf(stdout, "%-12s : %.1f MB allocated (%.1f MB index), %.1f MB free, "
+                "%.1f%% fragmented\n", "pool", st.allocated_bytes / 1048576.0,
+                st.index_bytes / 1048576.0, st.free_bytes / 1048576.0,
+                st.fragmentation * 100);
+        std::string classes;
+        for (int i = 0; i < PMKV_SIZE_CLASSES; i++) {
+            char buf[64];
+            if (st.alloc_bytes[i] == 0)
+                continue;
+            if (i == PMKV_SIZE_CLASSES - 1)
+                snprintf(buf, sizeof(buf), " >%zuK %.1f MB", (size_t)4 << (i - 1),
+                         st.alloc_bytes[i] / 1048576.0);
+            else
+                snprintf(buf, sizeof(buf), " <=%zuK %.1f MB", (size_t)4 << i,
+                         st.alloc_bytes[i] / 1048576.0);
+            classes += buf;
+        }
+        fprintf(stdout, "%-12s :%s\n", "allocations", classes.c_str());
+        fflush(stdout);
+    }
+
+    void PrintNumaStats() {
+        struct pmkv_stats st;
+        if (kv_->stats(&st) != pmem::kv::status::OK)
+            return;
+        size_t local = st.numa_local - numa_local_;
+        size_t remote = st.numa_remote - numa_remote_;
+        numa_local_ = st.numa_local;
+        numa_remote_ = st.numa_remote;
+        fprintf(stdout, "%-12s : %zu nodes, %zu local, %zu remote (%.1f%% local)\n", "numa",
+                st.nodes, local, remote,
+                local + remote ? local * 100.0 / (local + remote) : 0.0);
+        fflush(stdout);
+    }
+
+    void PrintFilterStats() {
+        struct pmkv_stats st;
+        if (kv_->stats(&st) != pmem::kv::status::OK)
+            return;
+        size_t passed = st.filter_negatives + st.filter_false_positives;
+        fprintf(stdout, "%-12s : %.1f MB, %zu misses filtered, %.3f%% false positives\n",
+                "filter", st.filter_bytes / 1048576.0, st.filter_negatives,
+                passed ? st.filter_false_positives * 100.0 / passed : 0.0);
+        fflush(stdout);
+    }
+
     void ReadWhileWriting(ThreadState* thread) {
         if (thread->tid > 0) {
             ReadRandom(thread);
@@ -827,6 +2114,90 @@ private:
         }
     }
 
+    // Each thread loads a contiguous share of the records
+    void YcsbLoad(ThreadState *thread) {
+        RandomGenerator gen;
+        std::unique_ptr<const char[]> key_guard;
+        Slice key = AllocateKey(key_guard);
+        int64_t first = (int64_t)FLAGS_ycsb_records * thread->tid / FLAGS_threads;
+        int64_t last = (int64_t)FLAGS_ycsb_records * (thread->tid + 1) / FLAGS_threads;
+        int64_t bytes = 0;
+
+        for (int64_t i = first; i < last; i++) {
+            GenerateKeyFromInt(i, FLAGS_ycsb_records, &key);
+            Slice value = gen.Generate(value_size_);
+            kv_->put(AsView(key), AsView(value));
+            thread->stats.FinishedSingleOp(kInsert);
+            bytes += key.size() + value.size();
+        }
+        thread->stats.AddBytes(bytes);
+    }
+
+    // Runs --ycsb_ops operations of workload ycsb_ over all threads
+    void Ycsb(ThreadState *thread) {
+        const YcsbWorkload &w = *ycsb_;
+        KeyGenerator keys(FLAGS_key_dist >= 0 ? FLAGS_key_dist : w.dist, &thread->rand,
+                          ycsb_zipf_.get(), thread->tid * (FLAGS_ycsb_records / FLAGS_threads));
+        RandomGenerator gen;
+        std::string value;
+        std::unique_ptr<const char[]> key_guard;
+        Slice key = AllocateKey(key_guard);
+        int64_t ops = std::max(FLAGS_ycsb_ops / FLAGS_threads, 1);
+        int64_t reads = 0, found = 0;
+        int64_t bytes = 0;
+
+        Duration duration(FLAGS_duration, ops);
+        while (!duration.Done(1)) {
+            int64_t count = ycsb_count_.load(std::memory_order_relaxed);
+            int p = thread->rand.Next() % 100;
+            OperationType type;
+
+            if (p < w.read) {
+                type = kRead;
+                GenerateKeyFromInt(keys.Next(count), FLAGS_ycsb_records, &key);
+                if (kv_->get(AsView(key), &value) == pmem::kv::status::OK) found++;
+                reads++;
+                bytes += key.size() + value.size();
+            } else if ((p -= w.read) < w.update) {
+                type = kUpdate;
+                GenerateKeyFromInt(keys.Next(count), FLAGS_ycsb_records, &key);
+                Slice v = gen.Generate(value_size_);
+                kv_->put(AsView(key), AsView(v));
+                bytes += key.size() + v.size();
+            } else if ((p -= w.update) < w.insert) {
+                type = kInsert;
+                GenerateKeyFromInt(ycsb_count_.fetch_add(1), FLAGS_ycsb_records, &key);
+                Slice v = gen.Generate(value_size_);
+                kv_->put(AsView(key), AsView(v));
+                bytes += key.size() + v.size();
+            } else if ((p -= w.insert) < w.scan) {
+                // no ordered iteration in the engines: read consecutive records
+                type = kScan;
+                int64_t first = keys.Next(count);
+                int64_t len = 1 + thread->rand.Next() % kYcsbMaxScan;
+                for (int64_t k = first; k < first + len && k < count; k++) {
+                    GenerateKeyFromInt(k, FLAGS_ycsb_records, &key);
+                    if (kv_->get(AsView(key), &value) == pmem::kv::status::OK) found++;
+                    reads++;
+                    bytes += key.size() + value.size();
+                }
+            } else {
+                type = kReadModifyWrite;
+                GenerateKeyFromInt(keys.Next(count), FLAGS_ycsb_records, &key);
+                Slice v = gen.Generate(value_size_);
+                if (kv_->read_modify_write(AsView(key), &value, AsView(v)) ==
+                    pmem::kv::status::OK) found++;
+                reads++;
+                bytes += 2 * key.size() + value.size() + v.size();
+            }
+            thread->stats.FinishedSingleOp(type);
+        }
+        thread->stats.AddBytes(bytes);
+        char msg[100];
+        snprintf(msg, sizeof(msg), "(%" PRId64 " of %" PRId64 " found)", found, reads);
+        thread->stats.AddMessage(msg);
+    }
+
     void ReadRandomWriteRandom(ThreadState* thread) {
         RandomGenerator gen;
         std::string value;
@@ -837,13 +2208,14 @@ private:
         int64_t writes_done = 0;
         int64_t bytes = 0;
         Duration duration(FLAGS_duration, readwrites_);
+        KeyGenerator keys = RandomKeys(thread);
 
         std::unique_ptr<const char[]> key_guard;
         Slice key = AllocateKey(key_guard);
 
         // the number of iterations is the larger of read_ or write_
         while (!duration.Done(1)) {
-            GenerateKeyFromInt(thread->rand.Next() % FLAGS_num, FLAGS_num, &key);
+            GenerateKeyFromInt(keys.Next(FLAGS_num), FLAGS_num, &key);
             if (get_weight == 0 && put_weight == 0) {
                 // one batch completed, reinitialize for next batch
                 get_weight = FLAGS_readwritepercent;
@@ -851,7 +2223,7 @@ private:
             }
             if (get_weight > 0) {
                 value.clear();
-                pmem::kv::status s = kv_->get(key.ToString(), &value);
+                pmem::kv::status s = kv_->get(AsView(key), &value);
                 if (s == pmem::kv::status::OK) {
                     found++;
                 } else if (s != pmem::kv::status::NOT_FOUND) {
@@ -861,11 +2233,11 @@ private:
                 bytes += value.length() + key.size();
                 get_weight--;
                 reads_done++;
-                thread->stats.FinishedSingleOp();
+                thread->stats.FinishedSingleOp(kRead);
             } else if (put_weight > 0) {
                 // then do all the corresponding number of puts
                 // for all the gets we have done earlier
-                pmem::kv::status s = kv_->put(key.ToString(), gen.Generate(value_size_).ToString());
+                pmem::kv::status s = kv_->put(AsView(key), AsView(gen.Generate(value_size_)));
                 if (s != pmem::kv::status::OK) {
                     fprintf(stderr, "put error\n");
                     exit(1);
@@ -873,7 +2245,7 @@ private:
                 bytes += key.size() + value_size_;
                 put_weight--;
                 writes_done++;
-                thread->stats.FinishedSingleOp();
+                thread->stats.FinishedSingleOp(kWrite);
             }
         }
         thread->stats.AddBytes(bytes);
@@ -899,6 +2271,7 @@ int main(int argc, char **argv) {
     // Parse command-line arguments
     for (int i = 1; i < argc; i++) {
         int n;
+        double d;
         char junk;
         if (leveldb::Slice(argv[i]).starts_with("--benchmarks=")) {
             FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
@@ -918,18 +2291,95 @@ int main(int argc, char **argv) {
             FLAGS_value_size = n;
         } else if (sscanf(argv[i], "--readwritepercent=%d%c", &n, &junk) == 1) {
             FLAGS_readwritepercent = n;
+        } else if (sscanf(argv[i], "--pool_passes=%d%c", &n, &junk) == 1) {
+            FLAGS_pool_passes = n;
+        } else if (strncmp(argv[i], "--hash=", 7) == 0) {
+            FLAGS_hash = -1;
+            for (int h = 0; h < 4; h++) {
+                if (strcmp(argv[i] + 7, hash_names[h]) == 0) FLAGS_hash = h;
+            }
+            if (FLAGS_hash < 0) {
+                fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (sscanf(argv[i], "--fixed_key=%d%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_fixed_key = n;
+        } else if (sscanf(argv[i], "--numa=%d%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_numa = n;
+        } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1 && d > 0 && d <= 1) {
+            FLAGS_compression_ratio = d;
+        } else if (strncmp(argv[i], "--compression=", 14) == 0) {
+            FLAGS_codec = -1;
+            for (int c = 0; c < 2; c++) {
+                if (strcmp(argv[i] + 14, codec_names[c]) == 0) FLAGS_codec = c;
+            }
+            if (FLAGS_codec < 0) {
+                fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (sscanf(argv[i], "--compress_min=%d%c", &n, &junk) == 1) {
+            FLAGS_compress_min = n;
+        } else if (strncmp(argv[i], "--key_dist=", 11) == 0) {
+            FLAGS_key_dist = -1;
+            for (int k = 0; k < kNumKeyDists; k++) {
+                if (strcmp(argv[i] + 11, key_dist_names[k]) == 0) FLAGS_key_dist = k;
+            }
+            if (FLAGS_key_dist < 0) {
+                fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (strncmp(argv[i], "--output_format=", 16) == 0) {
+            FLAGS_output_format = -1;
+            for (int k = kText; k <= kCsv; k++) {
+                if (strcmp(argv[i] + 16, output_format_names[k]) == 0) FLAGS_output_format = k;
+            }
+            if (FLAGS_output_format < 0) {
+                fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+                exit(1);
+            }
+        } else if (sscanf(argv[i], "--calibrate=%d%c", &n, &junk) == 1 && (n == 0 || n == 1)) {
+            FLAGS_calibrate = n;
+        } else if (sscanf(argv[i], "--duration=%d%c", &n, &junk) == 1 && n >= 0) {
+            FLAGS_duration = n;
+        } else if (sscanf(argv[i], "--report_interval=%lf%c", &d, &junk) == 1 && d >= 0) {
+            FLAGS_report_interval = d;
+        } else if (sscanf(argv[i], "--target_qps=%lf%c", &d, &junk) == 1 && d >= 0) {
+            FLAGS_target_qps = d;
+        } else if (strcmp(argv[i], "--arrival=poisson") == 0) {
+            FLAGS_poisson = true;
+        } else if (strcmp(argv[i], "--arrival=constant") == 0) {
+            FLAGS_poisson = false;
+        } else if (strncmp(argv[i], "--output_file=", 14) == 0) {
+            FLAGS_output_file = argv[i] + 14;
+        } else if (sscanf(argv[i], "--seed=%d%c", &n, &junk) == 1) {
+            FLAGS_seed = n;
+        } else if (sscanf(argv[i], "--ycsb_records=%d%c", &n, &junk) == 1 && n > 0) {
+            FLAGS_ycsb_records = n;
+        } else if (sscanf(argv[i], "--ycsb_ops=%d%c", &n, &junk) == 1 && n > 0) {
+            FLAGS_ycsb_ops = n;
+        } else if (sscanf(argv[i], "--cache_mb=%d%c", &n, &junk) == 1) {
+            FLAGS_cache_mb = n;
+        } else if (sscanf(argv[i], "--zipf_theta=%lf%c", &d, &junk) == 1 && d > 0 && d != 1) {
+            FLAGS_zipf_theta = d;
         } else if (strncmp(argv[i], "--db=", 5) == 0) {
             FLAGS_db = argv[i] + 5;
         } else if (sscanf(argv[i], "--db_size_in_gb=%d%c", &n, &junk) == 1) {
             FLAGS_db_size_in_gb = n;
+        } else if (sscanf(argv[i], "--grow_in_gb=%d%c", &n, &junk) == 1) {
+            FLAGS_grow_in_gb = n;
         } else {
             fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
             exit(1);
         }
     }
+    if (FLAGS_fixed_key && FLAGS_key_size != PMKV_FIXED_KEY_SIZE) {
+        fprintf(stderr, "--fixed_key=1 needs --key_size=%d\n", PMKV_FIXED_KEY_SIZE);
+        exit(1);
+    }
 
     // Run benchmark against default environment
     g_env = leveldb::Env::Default();
+    InitTimer();
     Benchmark benchmark;
     benchmark.Run();
     return 0;
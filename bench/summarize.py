@@ -1,3 +1,4 @@
+import json
 import sys
 
 benchmarks = [
@@ -17,41 +18,45 @@ benchmarks = [
 	('deleterandom', '1024'),
 ]
 
+def load_result(name, val_size):
+	# aggregate throughput and worst per-operation p99 of the last 'name'
+	# benchmark that bench wrote with --output_format=json
+	file_name = '%s_%s.json' % (name, val_size)
+	with open(file_name) as f:
+		result = json.load(f)
+	runs = [b for b in result['benchmarks'] if b['name'] == name]
+	if not runs:
+		raise ValueError('%s has no %s result' % (file_name, name))
+	aggregate = runs[-1]['aggregate']
+	p99 = max(lat['p99'] for lat in aggregate['latency_us'].values())
+	return aggregate['ops_per_sec'], p99
+
 if __name__ == "__main__":
 	if len(sys.argv) != 2:
-		print "python %s output_file" % sys.argv[0]
+		print("python %s output_file" % sys.argv[0])
 		sys.exit(1)
 
 	outfile_name = sys.argv[1]
 
-	# fillrandom   :      15.140 micros/op 66048 ops/sec;   65.5 MB/s
-	# fillrandom   :      15.140 micros/op 66051 ops/sec;   65.5 MB/s
-	# fillrandom   :      15.100 micros/op 66225 ops/sec;   65.7 MB/s
-	# fillrandom   :      15.047 micros/op 66460 ops/sec;   65.9 MB/s
-
 	files = []
 	tputs = []
+	p99s = []
 	for name, val_size in benchmarks:
-		file_name = '%s_%s.txt' % (name, val_size)
-		files.append(file_name)
-		tput = 0
+		files.append('%s_%s' % (name, val_size))
 		try:
-			with open(file_name) as f:
-				lines = f.readlines()[-4:]
-				for line in lines:
-					words = line.strip().split()
-					bench_name = words[0]
-					assert bench_name == name
-					tput += int(words[4])
-		except:
-			tput = 0
-		tputs.append(tput)
-	files.insert(0, 'AverageThroughput')
-	print tputs
+			tput, p99 = load_result(name, val_size)
+		except (IOError, ValueError, KeyError) as e:
+			sys.stderr.write('%s_%s: %s\n' % (name, val_size, e))
+			tput, p99 = 0, 0
+		tputs.append(int(tput))
+		p99s.append(p99)
+	print(tputs)
 	mean = int(sum(tputs) / len(tputs))
-	print "avg: %d ops/sec" % mean
-	tputs.insert(0, mean)
-	tputs = map(lambda x: str(x), tputs)
+	print("avg: %d ops/sec" % mean)
+	mean_p99 = sum(p99s) / len(p99s)
+	print("avg p99: %.3f micros" % mean_p99)
+	names = ['AverageThroughput', 'AverageP99Micros'] + files
+	values = [str(mean), '%.3f' % mean_p99] + [str(t) for t in tputs]
 	with open(outfile_name, 'w') as f:
-		f.write("%s\n" % ",".join(files))
-		f.write("%s\n" % ",".join(tputs))
+		f.write("%s\n" % ",".join(names))
+		f.write("%s\n" % ",".join(values))
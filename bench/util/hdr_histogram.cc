@@ -0,0 +1,74 @@
+#include <string.h>
+#include "util/hdr_histogram.h"
+
+namespace leveldb {
+
+int HdrHistogram::BucketFor(uint64_t value) {
+  if (value < kSubBuckets) return static_cast<int>(value);
+  int msb = 63 - __builtin_clzll(value);
+  if (msb >= kMaxBits) return kNumBuckets - 1;
+  // value >> shift lies in [kSubBuckets / 2, kSubBuckets)
+  int shift = msb - (kSubBucketBits - 1);
+  return kSubBuckets + (shift - 1) * (kSubBuckets / 2) +
+         static_cast<int>((value >> shift) - kSubBuckets / 2);
+}
+
+uint64_t HdrHistogram::BucketLimit(int b) {
+  if (b < kSubBuckets) return b;
+  int shift = (b - kSubBuckets) / (kSubBuckets / 2) + 1;
+  uint64_t sub = (b - kSubBuckets) % (kSubBuckets / 2) + kSubBuckets / 2;
+  return ((sub + 1) << shift) - 1;
+}
+
+void HdrHistogram::Clear() {
+  memset(buckets_, 0, sizeof(buckets_[0]) * (top_ + 1));
+  count_ = 0;
+  min_ = UINT64_MAX;
+  max_ = 0;
+  sum_ = 0;
+  top_ = 0;
+}
+
+void HdrHistogram::Add(uint64_t value) {
+  int b = BucketFor(value);
+  buckets_[b]++;
+  if (b > top_) top_ = b;
+  if (value < min_) min_ = value;
+  if (value > max_) max_ = value;
+  count_++;
+  sum_ += value;
+}
+
+void HdrHistogram::Merge(const HdrHistogram& other) {
+  if (other.count_ == 0) return;
+  for (int b = 0; b <= other.top_; b++) {
+    buckets_[b] += other.buckets_[b];
+  }
+  if (other.top_ > top_) top_ = other.top_;
+  if (other.min_ < min_) min_ = other.min_;
+  if (other.max_ > max_) max_ = other.max_;
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+double HdrHistogram::Average() const {
+  if (count_ == 0) return 0;
+  return sum_ / count_;
+}
+
+uint64_t HdrHistogram::Percentile(double p) const {
+  if (count_ == 0) return 0;
+  uint64_t threshold = static_cast<uint64_t>(count_ * (p / 100.0) + 0.5);
+  if (threshold < 1) threshold = 1;
+  uint64_t sum = 0;
+  for (int b = 0; b <= top_; b++) {
+    sum += buckets_[b];
+    if (sum >= threshold) {
+      uint64_t r = BucketLimit(b);
+      return r < max_ ? r : max_;
+    }
+  }
+  return max_;
+}
+
+}  // namespace leveldb
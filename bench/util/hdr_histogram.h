@@ -0,0 +1,48 @@
+#ifndef STORAGE_LEVELDB_UTIL_HDR_HISTOGRAM_H_
+#define STORAGE_LEVELDB_UTIL_HDR_HISTOGRAM_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+// Log-linear histogram of integer values such as nanosecond latencies.
+// Values below 2^kSubBucketBits get a bucket each; above that every power
+// of two is split into kSubBuckets/2 linear buckets, so a reported value is
+// within 1/128 of the true one.  Add is a shift and an increment.
+class HdrHistogram {
+ public:
+  HdrHistogram() { top_ = kNumBuckets - 1; Clear(); }
+
+  void Clear();
+  void Add(uint64_t value);
+  void Merge(const HdrHistogram& other);
+
+  uint64_t Count() const { return count_; }
+  uint64_t Min() const { return count_ == 0 ? 0 : min_; }
+  uint64_t Max() const { return max_; }
+  double Average() const;
+  // Highest value of the bucket holding the p-th percentile, at most Max()
+  uint64_t Percentile(double p) const;
+
+ private:
+  enum {
+    kSubBucketBits = 8,
+    kSubBuckets = 1 << kSubBucketBits,
+    kMaxBits = 40,      // larger values (over 18 minutes in ns) share the last bucket
+    kNumBuckets = kSubBuckets + (kMaxBits - kSubBucketBits) * (kSubBuckets / 2)
+  };
+
+  static int BucketFor(uint64_t value);
+  static uint64_t BucketLimit(int b);
+
+  uint64_t count_;
+  uint64_t min_;
+  uint64_t max_;
+  double sum_;
+  int top_;             // highest bucket in use; Clear and Merge stop there
+  uint64_t buckets_[kNumBuckets];
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_HDR_HISTOGRAM_H_
@@ -1,15 +1,115 @@
 #ifndef __PMKV_H
 #define __PMKV_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define MAX_VAL_LEN 1048576
+#define PMKV_MAX_NODES 8
+/* Class i of pmkv_stats.alloc_bytes: allocations of up to 4 KiB << i bytes */
+#define PMKV_SIZE_CLASSES 16
 
 typedef struct {} pmkv;
 
+struct pmkv_stats {
+	/* footprint */
+	size_t live_keys;
+	size_t pool_bytes;		/* size of the pool files */
+	size_t allocated_bytes;		/* heap allocations: log chunks, index tables, root */
+	size_t alloc_bytes[PMKV_SIZE_CLASSES];	/* the same by size class, the last one unbounded */
+	size_t index_bytes;		/* persistent index tables */
+	size_t dram_index_bytes;	/* shard state, filters and chunk directory */
+	size_t free_bytes;		/* pool bytes not allocated, libpmemobj metadata included */
+	double fragmentation;		/* share of allocated bytes in chunks but not in live records */
+
+	/* record log */
+	size_t log_chunks;		/* chunks currently holding records */
+	size_t log_bytes;		/* bytes of those chunks */
+	size_t live_bytes;		/* bytes of records reachable from the index */
+
+	/* compaction */
+	size_t compacted_chunks;	/* chunks emptied by the compactor */
+	size_t compacted_bytes;		/* bytes of live records it relocated */
+	size_t reclaimed_chunks;	/* chunks returned to the pool heap */
+
+	/*
+	 * DRAM filter; its false-positive rate is
+	 * filter_false_positives / (filter_negatives + filter_false_positives)
+	 */
+	size_t filter_bytes;		/* memory held by the shard filters */
+	size_t filter_negatives;	/* lookups answered by the filter alone */
+	size_t filter_false_positives;	/* lookups it passed that then missed */
+
+	/* DRAM read cache, all 0 when disabled */
+	size_t cache_bytes;		/* bytes of cached entries */
+	size_t cache_hits;
+	size_t cache_misses;
+
+	size_t hash;			/* enum pmkv_hash in use */
+	size_t key_size;		/* fixed key size of the pool, 0 if variable */
+
+	/* NUMA: accesses by threads bound with pmkv_bind_thread() */
+	size_t nodes;			/* node pools the store spans */
+	size_t numa_local;		/* to a pool on the thread's node */
+	size_t numa_remote;		/* to a pool on another node */
+
+	/* value compression */
+	size_t compressed_puts;		/* values stored compressed */
+	size_t compressed_saved;	/* bytes those saved before padding */
+};
+
+enum pmkv_hash {
+	PMKV_HASH_AUTO = 0,		/* fastest kernel this CPU supports */
+	PMKV_HASH_PORTABLE,		/* wyhash */
+	PMKV_HASH_CRC32C,		/* SSE4.2 */
+	PMKV_HASH_AES,			/* AES-NI */
+};
+
+enum pmkv_codec {
+	PMKV_CODEC_NONE = 0,
+	PMKV_CODEC_ZSTD,		/* zstd frame, level 1 */
+};
+
+#define PMKV_FIXED_KEY_SIZE	16
+
+struct pmkv_options {
+	size_t cache_bytes;		/* DRAM read cache size, 0 disables it */
+	int hash;			/* enum pmkv_hash; only used when creating */
+	/*
+	 * 0 for variable-size keys, or PMKV_FIXED_KEY_SIZE for a pool that only
+	 * takes keys of exactly that size and keeps them inline in its index.
+	 * Only used when creating.
+	 */
+	size_t key_size;
+	/*
+	 * Reopen only: extend the pool by this many bytes first.  libpmemobj
+	 * does that for a poolset with a directory part by appending a part
+	 * file; for any other pool the open fails.
+	 */
+	size_t grow_bytes;
+	/*
+	 * Puts of values of at least compress_min bytes try 'codec' and keep
+	 * the result if it saves an eighth or more.  The codec is stored per
+	 * record, so this can change from one open to the next.
+	 */
+	int codec;			/* enum pmkv_codec */
+	size_t compress_min;
+	/*
+	 * Spread the store over one pool per NUMA node: node_paths[i] is the
+	 * pool on node i, for i < nodes, each of pool_size bytes.  The path
+	 * argument of pmkv_open_opts() is ignored then.  0 opens one pool.
+	 */
+	const char *node_paths[PMKV_MAX_NODES];
+	int nodes;
+};
+
 pmkv* pmkv_open(const char *path, size_t pool_size, int force_create);
+pmkv* pmkv_open_opts(const char *path, size_t pool_size, int force_create,
+		const struct pmkv_options *opts);
 void pmkv_close(pmkv *kv);
 int pmkv_get(pmkv *kv, const char *key, size_t key_size, char *out_val, size_t *out_val_size);
 int pmkv_put(pmkv *kv, const char *key, size_t key_size, const char *val, size_t val_size);
@@ -17,6 +117,49 @@ int pmkv_delete(pmkv *kv, const char *key, size_t key_size);
 int pmkv_count_all(pmkv *kv, size_t *out_cnt);
 int pmkv_exists(pmkv *kv, const char *key, size_t key_size);
 
+/*
+ * Hash a key once and reuse it across calls.  The value is opaque and only
+ * valid with the same key on the same kv.
+ */
+uint64_t pmkv_hash_key(pmkv *kv, const char *key, size_t key_size);
+int pmkv_get_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size,
+		char *out_val, size_t *out_val_size);
+int pmkv_put_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size,
+		const char *val, size_t val_size);
+int pmkv_delete_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size);
+int pmkv_exists_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size);
+
+int pmkv_compact(pmkv *kv);
+int pmkv_get_stats(pmkv *kv, struct pmkv_stats *out);
+
+/*
+ * A store opened with pmkv_options.node_paths spans one pool per NUMA node
+ * and partitions keys between them by hash.  A poolset file is a single
+ * pool to PMKV and lives on one node; its size comes from the set file and
+ * pool_size is ignored.
+ */
+int pmkv_nodes(pmkv *kv);
+int pmkv_key_node(pmkv *kv, uint64_t hash);	/* node of a pmkv_hash_key() value */
+/*
+ * Pin the calling thread to the CPUs of 'node', one of kv's nodes, and count
+ * its accesses.  The binding is the thread's: it holds for every store the
+ * thread uses, with node numbers taken as NUMA node ids.
+ */
+int pmkv_bind_thread(pmkv *kv, int node);
+
+#ifdef PMKV_TESTING
+/*
+ * Crash injection, built only with -DPMKV_TESTING: the process kills itself
+ * with SIGKILL the n-th time it reaches 'point'.  n = 0 disarms the point.
+ */
+enum pmkv_crash_point {
+	PMKV_CRASH_MIGRATE,	/* resize: an entry in both tables */
+	PMKV_CRASH_UNDO,	/* in-place overwrite: value written, undo slot armed */
+	PMKV_CRASH_POINTS
+};
+void pmkv_crash_at(int point, long n);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,6 +24,23 @@ output_files = [
 	'PMKVTest.RemoveHeadlessTest',
 	'PMKVTest.RemoveNonexistentTest',
 	'PMKVTest.SimpleMultithreadedTest',
+	'PMKVTest.InPlaceUpdateTest',
+	'PMKVTest.InPlaceRecoveryTest',
+	'PMKVTest.CompactionTest',
+	'PMKVTest.ShrinkTest',
+	'PMKVTest.ResizeResumeTest',
+	'PMKVTest.FingerprintTest',
+	'PMKVTest.FilterTest',
+	'PMKVTest.CacheTest',
+	'PMKVTest.HashedTest',
+	'PMKVTest.HashKernelTest',
+	'PMKVTest.FixedKeyTest',
+	'PMKVTest.NumaTest',
+	'PMKVTest.PoolsetTest',
+	'PMKVTest.PoolsetGrowTest',
+	'PMKVTest.CompressionTest',
+	'PMKVTest.CodecTest',
+	'PMKVTest.FootprintTest',
 	'PMKVLargeTest.LargeAscendingTest',
 	'PMKVLargeTest.LargeAscendingAfterRecoveryTest',
 	'PMKVLargeTest.LargeDescendingTest',
@@ -52,4 +69,9 @@ figures_of_merit=[
 		'field': 'AverageThroughput',
 		'name': 'Average Throughput',
 	},
+	{
+		'file': 'bench/perf.csv',
+		'field': 'AverageP99Micros',
+		'name': 'Average p99 Latency (us)',
+	},
 ]
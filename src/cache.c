@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cache.h"
+
+#define CACHE_SHARDS		64
+#define CACHE_INIT_BUCKETS	256
+#define CACHE_INIT_RING		256
+#define CACHE_MAX_SHARE		8	/* no entry may take more than 1/8 of a shard */
+
+struct cache_entry {
+	struct cache_entry *chain;	/* next in hash bucket */
+	uint64_t hash;
+	size_t key_size;
+	size_t val_size;
+	uint32_t pos;			/* index in the clock ring */
+	uint8_t ref;			/* hit since the hand last passed */
+	char data[];			/* key, then value */
+};
+
+struct cache_shard {
+	pthread_mutex_t lock;
+	struct cache_entry **bucket;
+	uint64_t mask;
+	struct cache_entry **ring;
+	uint32_t nring;
+	uint32_t ring_cap;
+	uint32_t hand;
+	size_t bytes;
+	size_t limit;
+	uint64_t hits;
+	uint64_t misses;
+} __attribute__((aligned(64)));
+
+struct cache {
+	struct cache_shard shard[CACHE_SHARDS];
+};
+
+static inline size_t entry_charge(size_t key_size, size_t val_size)
+{
+	return sizeof(struct cache_entry) + key_size + val_size;
+}
+
+/* bits 40-45 are used by neither the shard nor the bucket number */
+static inline struct cache_shard *shard_of(struct cache *c, uint64_t hash)
+{
+	return &c->shard[(hash >> 40) % CACHE_SHARDS];
+}
+
+static struct cache_entry **entry_find(struct cache_shard *sh, uint64_t hash,
+		const char *key, size_t key_size)
+{
+	struct cache_entry **p = &sh->bucket[hash & sh->mask];
+
+	for (; *p != NULL; p = &(*p)->chain) {
+		struct cache_entry *e = *p;
+
+		if (e->hash == hash && e->key_size == key_size &&
+		    memcmp(e->data, key, key_size) == 0)
+			return p;
+	}
+	return NULL;
+}
+
+/* Unlink the entry '*p' points at from its bucket and the ring, and free it. */
+static void entry_drop(struct cache_shard *sh, struct cache_entry **p)
+{
+	struct cache_entry *e = *p;
+
+	*p = e->chain;
+	sh->ring[e->pos] = sh->ring[--sh->nring];
+	sh->ring[e->pos]->pos = e->pos;
+	if (sh->hand >= sh->nring)
+		sh->hand = 0;
+	sh->bytes -= entry_charge(e->key_size, e->val_size);
+	free(e);
+}
+
+static void shard_evict(struct cache_shard *sh, size_t need)
+{
+	while (sh->nring > 0 && sh->bytes + need > sh->limit) {
+		struct cache_entry *e = sh->ring[sh->hand];
+
+		if (e->ref) {
+			e->ref = 0;
+			sh->hand = (sh->hand + 1) % sh->nring;
+			continue;
+		}
+		entry_drop(sh, entry_find(sh, e->hash, e->data, e->key_size));
+	}
+}
+
+static void shard_rehash(struct cache_shard *sh)
+{
+	uint64_t nbuckets = (sh->mask + 1) * 2;
+	struct cache_entry **bucket = calloc(nbuckets, sizeof(*bucket));
+	uint32_t i;
+
+	if (bucket == NULL)
+		return;
+	for (i = 0; i < sh->nring; i++) {
+		struct cache_entry *e = sh->ring[i];
+
+		e->chain = bucket[e->hash & (nbuckets - 1)];
+		bucket[e->hash & (nbuckets - 1)] = e;
+	}
+	free(sh->bucket);
+	sh->bucket = bucket;
+	sh->mask = nbuckets - 1;
+}
+
+struct cache *cache_new(size_t bytes)
+{
+	struct cache *c;
+	int i;
+
+	if (posix_memalign((void **)&c, 64, sizeof(*c)))
+		return NULL;
+	memset(c, 0, sizeof(*c));
+	for (i = 0; i < CACHE_SHARDS; i++) {
+		struct cache_shard *sh = &c->shard[i];
+
+		pthread_mutex_init(&sh->lock, NULL);
+		sh->limit = bytes / CACHE_SHARDS;
+		sh->mask = CACHE_INIT_BUCKETS - 1;
+		sh->bucket = calloc(CACHE_INIT_BUCKETS, sizeof(*sh->bucket));
+		sh->ring_cap = CACHE_INIT_RING;
+		sh->ring = malloc(CACHE_INIT_RING * sizeof(*sh->ring));
+		if (sh->bucket == NULL || sh->ring == NULL) {
+			cache_free(c);
+			return NULL;
+		}
+	}
+	return c;
+}
+
+void cache_free(struct cache *c)
+{
+	int i;
+	uint32_t j;
+
+	if (c == NULL)
+		return;
+	for (i = 0; i < CACHE_SHARDS; i++) {
+		struct cache_shard *sh = &c->shard[i];
+
+		for (j = 0; j < sh->nring; j++)
+			free(sh->ring[j]);
+		free(sh->ring);
+		free(sh->bucket);
+		pthread_mutex_destroy(&sh->lock);
+	}
+	free(c);
+}
+
+int cache_get(struct cache *c, uint64_t hash, const char *key, size_t key_size,
+		char *out_val, size_t *out_val_size)
+{
+	struct cache_shard *sh = shard_of(c, hash);
+	struct cache_entry **p;
+
+	pthread_mutex_lock(&sh->lock);
+	p = entry_find(sh, hash, key, key_size);
+	if (p == NULL) {
+		sh->misses++;
+		pthread_mutex_unlock(&sh->lock);
+		return 1;
+	}
+	(*p)->ref = 1;
+	if (out_val != NULL) {
+		memcpy(out_val, (*p)->data + key_size, (*p)->val_size);
+		*out_val_size = (*p)->val_size;
+	}
+	sh->hits++;
+	pthread_mutex_unlock(&sh->lock);
+	return 0;
+}
+
+void cache_put(struct cache *c, uint64_t hash, const char *key, size_t key_size,
+		const char *val, size_t val_size)
+{
+	struct cache_shard *sh = shard_of(c, hash);
+	size_t need = entry_charge(key_size, val_size);
+	struct cache_entry **p;
+	struct cache_entry *e;
+
+	pthread_mutex_lock(&sh->lock);
+	p = entry_find(sh, hash, key, key_size);
+	if (p != NULL) {
+		if ((*p)->val_size == val_size) {
+			memcpy((*p)->data + key_size, val, val_size);
+			goto out;
+		}
+		entry_drop(sh, p);
+	}
+	if (need > sh->limit / CACHE_MAX_SHARE)
+		goto out;
+	shard_evict(sh, need);
+
+	if (sh->nring == sh->ring_cap) {
+		struct cache_entry **ring = realloc(sh->ring, sh->ring_cap * 2 * sizeof(*ring));
+
+		if (ring == NULL)
+			goto out;
+		sh->ring = ring;
+		sh->ring_cap *= 2;
+	}
+	e = malloc(need);
+	if (e == NULL)
+		goto out;
+	e->hash = hash;
+	e->key_size = key_size;
+	e->val_size = val_size;
+	e->ref = 0;
+	memcpy(e->data, key, key_size);
+	memcpy(e->data + key_size, val, val_size);
+	e->chain = sh->bucket[hash & sh->mask];
+	sh->bucket[hash & sh->mask] = e;
+	e->pos = sh->nring;
+	sh->ring[sh->nring++] = e;
+	sh->bytes += need;
+	if (sh->nring > (sh->mask + 1) * 2)
+		shard_rehash(sh);
+out:
+	pthread_mutex_unlock(&sh->lock);
+}
+
+void cache_remove(struct cache *c, uint64_t hash, const char *key, size_t key_size)
+{
+	struct cache_shard *sh = shard_of(c, hash);
+	struct cache_entry **p;
+
+	pthread_mutex_lock(&sh->lock);
+	p = entry_find(sh, hash, key, key_size);
+	if (p != NULL)
+		entry_drop(sh, p);
+	pthread_mutex_unlock(&sh->lock);
+}
+
+void cache_stats(struct cache *c, size_t *bytes, size_t *hits, size_t *misses)
+{
+	int i;
+
+	*bytes = *hits = *misses = 0;
+	for (i = 0; i < CACHE_SHARDS; i++) {
+		struct cache_shard *sh = &c->shard[i];
+
+		pthread_mutex_lock(&sh->lock);
+		*bytes += sh->bytes;
+		*hits += sh->hits;
+		*misses += sh->misses;
+		pthread_mutex_unlock(&sh->lock);
+	}
+}
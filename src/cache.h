@@ -0,0 +1,28 @@
+#ifndef __PMKV_CACHE_H
+#define __PMKV_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Size-bounded DRAM cache of key/value pairs, keyed by the engine's key hash.
+ * It is split into independently locked shards and evicts with CLOCK.  The
+ * engine keeps it coherent by calling in only while holding the owning
+ * engine shard lock: reads and fills under the read lock, puts and removes
+ * under the write lock.
+ */
+struct cache;
+
+struct cache *cache_new(size_t bytes);
+void cache_free(struct cache *c);
+
+/* 0 on a hit; 'out_val' may be NULL to test presence only */
+int cache_get(struct cache *c, uint64_t hash, const char *key, size_t key_size,
+		char *out_val, size_t *out_val_size);
+void cache_put(struct cache *c, uint64_t hash, const char *key, size_t key_size,
+		const char *val, size_t val_size);
+void cache_remove(struct cache *c, uint64_t hash, const char *key, size_t key_size);
+
+void cache_stats(struct cache *c, size_t *bytes, size_t *hits, size_t *misses);
+
+#endif
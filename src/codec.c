@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "pmkv.h"
+#include "codec.h"
+#include "zstd/zstd.h"
+
+/*
+ * zstd frames at level 1, its fastest regular level, from the vendored
+ * reference library in zstd/.  Each thread keeps its own compression and
+ * decompression contexts, since creating them costs more than coding a value.
+ */
+#define ZSTD_LEVEL		1
+
+struct zstd_ctx {
+	ZSTD_CCtx *cctx;
+	ZSTD_DCtx *dctx;
+};
+
+static pthread_key_t zstd_key;
+static pthread_once_t zstd_once = PTHREAD_ONCE_INIT;
+static __thread struct zstd_ctx *zstd_ctx;
+
+static void zstd_ctx_free(void *p)
+{
+	struct zstd_ctx *ctx = p;
+
+	ZSTD_freeCCtx(ctx->cctx);
+	ZSTD_freeDCtx(ctx->dctx);
+	free(ctx);
+}
+
+static void zstd_key_init(void)
+{
+	pthread_key_create(&zstd_key, zstd_ctx_free);
+}
+
+/* The calling thread's contexts, NULL if out of memory */
+static struct zstd_ctx *zstd_thread_ctx(void)
+{
+	struct zstd_ctx *ctx = zstd_ctx;
+
+	if (ctx != NULL)
+		return ctx;
+	pthread_once(&zstd_once, zstd_key_init);
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL)
+		return NULL;
+	ctx->cctx = ZSTD_createCCtx();
+	ctx->dctx = ZSTD_createDCtx();
+	if (ctx->cctx == NULL || ctx->dctx == NULL ||
+	    ZSTD_isError(ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_compressionLevel, ZSTD_LEVEL))) {
+		zstd_ctx_free(ctx);
+		return NULL;
+	}
+	/* the key only frees the contexts when the thread exits */
+	pthread_setspecific(zstd_key, ctx);
+	zstd_ctx = ctx;
+	return ctx;
+}
+
+static size_t zstd_compress(const char *src, size_t size, char *dst, size_t cap)
+{
+	struct zstd_ctx *ctx = zstd_thread_ctx();
+	size_t n;
+
+	if (ctx == NULL)
+		return 0;
+	n = ZSTD_compress2(ctx->cctx, dst, cap, src, size);
+	return ZSTD_isError(n) ? 0 : n;
+}
+
+static long zstd_decompress(const char *src, size_t size, char *dst, size_t cap)
+{
+	struct zstd_ctx *ctx = zstd_thread_ctx();
+	size_t n;
+
+	if (ctx == NULL)
+		return -1;
+	n = ZSTD_decompressDCtx(ctx->dctx, dst, cap, src, size);
+	return ZSTD_isError(n) ? -1 : (long)n;
+}
+
+struct codec_ops {
+	size_t (*compress)(const char *src, size_t size, char *dst, size_t cap);
+	long (*decompress)(const char *src, size_t size, char *dst, size_t cap);
+};
+
+static const struct codec_ops codecs[] = {
+	[PMKV_CODEC_ZSTD] = { zstd_compress, zstd_decompress },
+};
+
+#define NCODECS		(sizeof(codecs) / sizeof(codecs[0]))
+
+size_t codec_compress(int codec, const char *src, size_t size, char *dst, size_t cap)
+{
+	if (codec <= 0 || (size_t)codec >= NCODECS || codecs[codec].compress == NULL)
+		return 0;
+	return codecs[codec].compress(src, size, dst, cap);
+}
+
+long codec_decompress(int codec, const char *src, size_t size, char *dst, size_t cap)
+{
+	if (codec <= 0 || (size_t)codec >= NCODECS || codecs[codec].decompress == NULL)
+		return -1;
+	return codecs[codec].decompress(src, size, dst, cap);
+}
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+static __thread char *scratch;
+static __thread size_t scratch_size;
+
+static void scratch_init(void)
+{
+	pthread_key_create(&scratch_key, free);
+}
+
+char *codec_scratch(size_t size)
+{
+	char *buf;
+
+	if (size <= scratch_size)
+		return scratch;
+	pthread_once(&scratch_once, scratch_init);
+	buf = realloc(scratch, size);
+	if (buf == NULL)
+		return NULL;
+	/* the key only frees the buffer when the thread exits */
+	pthread_setspecific(scratch_key, buf);
+	scratch = buf;
+	scratch_size = size;
+	return buf;
+}
@@ -0,0 +1,19 @@
+#ifndef __PMKV_CODEC_H
+#define __PMKV_CODEC_H
+
+#include <stddef.h>
+
+/*
+ * Value codecs, numbered by enum pmkv_codec.  The number is stored with every
+ * record, so a pool can hold values written under different settings.
+ */
+
+/* Compressed size, or 0 if 'src' does not fit in 'cap' bytes. */
+size_t codec_compress(int codec, const char *src, size_t size, char *dst, size_t cap);
+/* Decompressed size, or -1 if 'src' is corrupt or does not fit in 'cap'. */
+long codec_decompress(int codec, const char *src, size_t size, char *dst, size_t cap);
+
+/* Per-thread scratch buffer of at least 'size' bytes, NULL if out of memory */
+char *codec_scratch(size_t size);
+
+#endif
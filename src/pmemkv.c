@@ -25,6 +25,13 @@ pmkv* pmkv_open(const char *path, size_t pool_size, int force_create)
 	return (pmkv*)db;
 }
 
+pmkv* pmkv_open_opts(const char *path, size_t pool_size, int force_create,
+		const struct pmkv_options *opts)
+{
+	/* pmemkv engines have no DRAM cache to size */
+	return pmkv_open(path, pool_size, force_create);
+}
+
 void pmkv_close(pmkv *kv)
 {
 	pmemkv_close((pmemkv_db*)kv);
@@ -60,3 +67,60 @@ int pmkv_exists(pmkv *kv, const char *key, size_t key_size)
 	int s = pmemkv_exists(db, key, key_size);
 	return s == PMEMKV_STATUS_OK ? 1 : 0;
 }
+
+/* pmemkv hashes internally; the *_hashed calls just ignore the hash */
+uint64_t pmkv_hash_key(pmkv *kv, const char *key, size_t key_size)
+{
+	return 0;
+}
+
+int pmkv_get_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size,
+		char *out_val, size_t *out_val_size)
+{
+	return pmkv_get(kv, key, key_size, out_val, out_val_size);
+}
+
+int pmkv_put_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size,
+		const char *val, size_t val_size)
+{
+	return pmkv_put(kv, key, key_size, val, val_size);
+}
+
+int pmkv_delete_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size)
+{
+	return pmkv_delete(kv, key, key_size);
+}
+
+int pmkv_exists_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size)
+{
+	return pmkv_exists(kv, key, key_size);
+}
+
+int pmkv_compact(pmkv *kv)
+{
+	/* pmemkv engines manage their own space */
+	return 1;
+}
+
+int pmkv_get_stats(pmkv *kv, struct pmkv_stats *out)
+{
+	/* pmemkv does not expose its allocation state */
+	memset(out, 0, sizeof(*out));
+	return 1;
+}
+
+int pmkv_nodes(pmkv *kv)
+{
+	return 1;
+}
+
+int pmkv_key_node(pmkv *kv, uint64_t hash)
+{
+	return 0;
+}
+
+int pmkv_bind_thread(pmkv *kv, int node)
+{
+	/* the cmap engine is not NUMA aware */
+	return 1;
+}
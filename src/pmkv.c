@@ -1,46 +1,2219 @@
+#define _GNU_SOURCE
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <libpmemobj.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __x86_64__
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 #include "pmkv.h"
+#include "cache.h"
+#include "codec.h"
+
+/*
+ * PMKV layout
+ *
+ * The key space is split into NSHARDS shards by the top bits of the key hash.
+ * Each shard owns a persistent hash index (an array of cacheline-sized
+ * buckets holding record offsets) and an append-only log of records made of
+ * CHUNK_SIZE chunks allocated from the libpmemobj heap.  A put appends the
+ * record to the shard's log, persists it and then publishes it with a single
+ * 8-byte store into an index slot, so no pmemobj transaction is needed.
+ * Everything volatile (counts, per-chunk live bytes, log tails) is rebuilt
+ * from the index at open.
+ *
+ * Overwrites and deletes leave dead records behind in the log.  A background
+ * compactor relocates the live records out of mostly-dead chunks, repoints
+ * their index slots and hands the emptied chunks back to the heap.
+ *
+ * A shard index grows and shrinks without stopping the world: the old and
+ * the new table coexist while every write migrates a few buckets, and the
+ * persistent migration cursor lets a resize interrupted by a crash resume at
+ * open.
+ *
+ * In DRAM each shard keeps a counting Bloom filter over the hashes in its
+ * index, so most lookups of absent keys never touch PM.  It is sized with the
+ * index, rebuilt at open, and while a resize runs its successor is filled as
+ * buckets migrate.  An optional read cache (cache.c) sits in front of both.
+ *
+ * A pool created for fixed PMKV_FIXED_KEY_SIZE keys also stores each key next
+ * to its slot in the index, so lookups compare two words there and only
+ * dereference a record to read its value.
+ *
+ * A store can span several pools, one per NUMA node, each a complete PMKV
+ * pool of its own with its own shards and compactor.  Keys are routed to a
+ * pool by their hash, so every shard lives on exactly one node, and threads
+ * bound with pmkv_bind_thread() can tell local accesses from remote ones.
+ */
+
+#define PMKV_LAYOUT		"pmkv"
+#define PMKV_MAGIC		0x564b4d50ULL	/* "PMKV" */
+#define PMKV_VERSION		7
+
+#define SHARD_BITS		4
+#define NSHARDS			(1 << SHARD_BITS)
+
+#define BUCKET_SLOTS		7
+#define BUCKET_OVERFLOW		1ULL	/* some entry probed past this bucket */
+#define INIT_BUCKETS		64
+#define MAX_LOAD_PCT		75	/* grow the index above this load */
+#define MIN_LOAD_PCT		15	/* shrink it below this one */
+#define FIT_LOAD_PCT		50	/* load pmkv_compact() sizes the index for */
+
+#define RESIZE_STEP		4	/* old buckets migrated by every put or delete */
+#define RESIZE_BG_BATCH		256	/* old buckets migrated per background lock hold */
+
+/*
+ * Keep the request a bit under 1 MiB so the allocator header does not spill
+ * the chunk into another 256 KiB heap unit.
+ */
+#define CHUNK_SIZE		((1 << 20) - 256)
+#define CHUNK_PAGE_SIZE		1024
+#define CHUNK_DIR_PAGES		1024
+#define CHUNK_NONE		UINT32_MAX
+
+/* Largest same-size overwrite done in place through the shard undo slot */
+#define UNDO_MAX		4096
+
+#define COMPACT_LIVE_PCT	50		/* evacuate sealed chunks at most this full */
+#define COMPACT_MANUAL_PCT	90		/* same, for an explicit pmkv_compact() */
+#define COMPACT_URGENT_PCT	50		/* dead share of the log that lifts the rate limit */
+#define COMPACT_RATE		(64ULL << 20)	/* bytes relocated per second */
+#define COMPACT_BATCH		(64 << 10)	/* bytes relocated per shard lock hold */
+#define COMPACT_INTERVAL_MS	100
+
+/*
+ * A key bumps FILTER_K 4-bit counters inside one cacheline block.  Counters
+ * that saturate are never decremented again, so deletes cannot cause false
+ * negatives.
+ */
+#define FILTER_BLOCK		64	/* bytes, two counters each */
+#define FILTER_BUCKETS		2	/* index buckets per filter block */
+#define FILTER_K		4
+#define FILTER_MAX		15
+#define FILTER_MIX		0x9e3779b97f4a7c15ULL
+
+#define NODE_MIX		0xbf58476d1ce4e5b9ULL	/* spreads keys over node pools */
+
+#define COMPRESS_MIN_GAIN	8	/* keep a compressed value 1/8 smaller or more */
+
+enum pm_type {
+	PM_TYPE_TABLE = 1,
+	PM_TYPE_CHUNK,
+};
+
+/*
+ * Keys are stored whole.  Records land in chunks in hash order, so a prefix
+ * shared per chunk matched little of most keys, and every hit would pay a
+ * chunk header read to rebuild its key.  Measured, it saved no pool space.
+ */
+struct pm_record {
+	uint64_t hash;
+	uint32_t key_size;
+	uint32_t val_size;
+	uint32_t chunk_pos;	/* offset of this record inside its chunk */
+	uint8_t codec;		/* enum pmkv_codec the value is stored with */
+	uint8_t reserved[3];
+	char data[];		/* value padded to 8 bytes, then key */
+};
+
+struct pm_chunk {
+	uint64_t size;		/* bytes requested from the heap, header included */
+	uint32_t shard;
+	uint32_t vidx;		/* volatile: DRAM descriptor index, rewritten at open */
+	uint64_t pad[6];
+	char data[];
+};
+
+/*
+ * fp[] holds one byte of each slot's key hash so a lookup dereferences only
+ * the records whose fingerprint matches.  The fingerprints are a hint: a
+ * crash can leave one unpersisted, so they are recomputed at open.
+ */
+struct pm_bucket {
+	uint8_t flags;
+	uint8_t fp[BUCKET_SLOTS];
+	uint64_t slot[BUCKET_SLOTS];	/* record offsets, 0 when empty */
+};
+
+struct pm_table {
+	uint64_t nbuckets;
+	uint64_t pad[7];
+	struct pm_bucket buckets[];
+	/* fixed-key pools: then struct pm_key keys[nbuckets * BUCKET_SLOTS] */
+};
+
+/* Inline copy of a fixed-size key, valid while its slot is non-zero. */
+struct pm_key {
+	uint64_t w[2];
+};
+
+/*
+ * Undo slot for same-size overwrites that do not fit a single atomic store.
+ * Writers to a shard are serialized by the shard lock, so the slot is owned
+ * by whichever thread is currently writing to the shard.
+ */
+struct pm_undo {
+	uint64_t rec;		/* record being overwritten, 0 when clean */
+	uint64_t size;
+	char data[UNDO_MAX];
+};
+
+/*
+ * 'state' packs the index of the live table (bit 0) with the resize cursor
+ * (the remaining bits): 0 when no resize is running, otherwise one more than
+ * the next old bucket to migrate.  Keeping both in one word lets a finished
+ * resize switch to the new table with a single 8-byte store.
+ */
+#define RESIZE_CUR		1ULL
+#define RESIZE_SHIFT		1
+
+struct pm_shard {
+	PMEMoid table[2];
+	uint64_t state;
+	struct pm_undo undo;
+};
+
+struct pm_root {
+	uint64_t magic;
+	uint64_t version;
+	uint64_t hash;		/* enum pmkv_hash the pool was created with */
+	uint64_t key_size;	/* PMKV_FIXED_KEY_SIZE, or 0 for variable-size keys */
+	uint32_t node;		/* index of this pool among the store's node pools */
+	uint32_t nodes;
+	struct pm_shard shard[NSHARDS];
+};
+
+struct chunk_desc {
+	uint64_t off;		/* pool offset of the pm_chunk, 0 when unused */
+	uint64_t size;
+	uint64_t live;		/* bytes of records still referenced by the index */
+	uint32_t shard;
+	uint32_t next_free;
+};
+
+struct filter {
+	uint8_t *block;
+	unsigned int shift;	/* 64 - log2(number of blocks) */
+};
+
+struct shard {
+	pthread_rwlock_t lock;
+	struct pm_shard *pm;
+	struct pm_table *table;
+	uint64_t mask;
+	struct pm_table *next;	/* resize target, NULL when not resizing */
+	uint64_t next_mask;
+	uint64_t migrate;	/* next bucket of 'table' to migrate */
+	struct filter filter;	/* covers both tables */
+	struct filter next_filter;	/* covers 'next' only */
+	uint64_t count;
+	struct chunk_desc *log;	/* chunk currently appended to */
+	uint64_t log_tail;
+	uint64_t filter_neg;	/* lookups the filter answered */
+	uint64_t filter_fp;	/* lookups it let through that missed */
+	uint64_t numa_local;	/* accesses by bound threads on this pool's node */
+	uint64_t numa_remote;	/* and by ones bound elsewhere */
+	uint64_t compressed;	/* puts stored compressed */
+	uint64_t compress_saved;
+} __attribute__((aligned(64)));
+
+struct kv {
+	PMEMobjpool *pop;
+	char *base;
+	uint64_t uuid_lo;
+	struct pm_root *root;
+	struct shard shard[NSHARDS];
+
+	pthread_mutex_t chunk_lock;
+	struct chunk_desc *chunk_dir[CHUNK_DIR_PAGES];
+	uint32_t nchunk_desc;
+	uint32_t free_desc;
+
+	pthread_t compactor;
+	pthread_mutex_t compact_lock;
+	pthread_cond_t compact_cv;
+	int compact_stop;
+	uint64_t compact_chunks;
+	uint64_t compact_moved;
+	uint64_t chunks_reclaimed;
+
+	struct cache *cache;	/* NULL unless enabled at open */
+	uint64_t (*hash)(const char *key, size_t len);
+	int fixed_key;		/* keys are inline in the index */
+	int node;		/* NUMA node this pool lives on */
+	int nodes;
+	int codec;		/* for values of compress_min bytes or more */
+	size_t compress_min;
+	size_t pool_bytes;	/* size of the pool files at open */
+};
+
+/* The store handed out as pmkv: one kv per node pool. */
+struct db {
+	int nodes;
+	struct kv *node[PMKV_MAX_NODES];
+};
+
+/*
+ * Node the calling thread was bound to with pmkv_bind_thread(), or -1.  Like
+ * the CPU affinity it sets, it belongs to the thread, not to one store.
+ */
+static __thread int thread_node = -1;
+
+static inline void *pm_ptr(struct kv *kv, uint64_t off)
+{
+	return kv->base + off;
+}
+
+static inline uint64_t pm_off(struct kv *kv, const void *ptr)
+{
+	return (uint64_t)((const char *)ptr - kv->base);
+}
+
+static inline PMEMoid pm_oid(struct kv *kv, uint64_t off)
+{
+	PMEMoid oid = { kv->uuid_lo, off };
+	return oid;
+}
+
+static inline void persist(struct kv *kv, const void *addr, size_t len)
+{
+	pmemobj_persist(kv->pop, addr, len);
+}
+
+#ifdef PMKV_TESTING
+static long crash_countdown[PMKV_CRASH_POINTS];
+
+void pmkv_crash_at(int point, long n)
+{
+	__atomic_store_n(&crash_countdown[point], n, __ATOMIC_RELAXED);
+}
+
+/* Die like a power failure would, on the armed hit of 'point'. */
+static void crash_point(int point)
+{
+	if (__atomic_load_n(&crash_countdown[point], __ATOMIC_RELAXED) > 0 &&
+	    __atomic_sub_fetch(&crash_countdown[point], 1, __ATOMIC_RELAXED) == 0)
+		raise(SIGKILL);
+}
+#else
+#define crash_point(point)	do { } while (0)
+#endif
+
+/*
+ * Key hash kernels.  Which one a pool uses is fixed when it is created and
+ * recorded in its root, since hashes decide placement and are stored in the
+ * records.  All of them must spread entropy over the whole 64 bits: the top
+ * bits pick the shard, the bottom ones the bucket.
+ */
+
+/* portable: wyhash (final version 4, public domain) with its default secret */
+#define WY_S0			0xa0761d6478bd642fULL
+#define WY_S1			0xe7037ed1a0b428dbULL
+#define WY_S2			0x8ebc6af09c88c6e3ULL
+#define WY_S3			0x589965cc75374cc3ULL
+
+static inline void wy_mum(uint64_t *a, uint64_t *b)
+{
+	__uint128_t r = (__uint128_t)*a * *b;
+
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+	wy_mum(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t wy_r8(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t wy_r4(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/* Load a key of at most 16 bytes as two words without reading past it. */
+static inline void wy_small(const uint8_t *p, size_t len, uint64_t *a, uint64_t *b)
+{
+	if (len >= 4) {
+		*a = (wy_r4(p) << 32) | wy_r4(p + ((len >> 3) << 2));
+		*b = (wy_r4(p + len - 4) << 32) | wy_r4(p + len - 4 - ((len >> 3) << 2));
+	} else if (len > 0) {
+		*a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+		*b = 0;
+	} else {
+		*a = *b = 0;
+	}
+}
+
+static uint64_t hash_wy(const char *key, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)key;
+	uint64_t seed = wy_mix(WY_S0, WY_S1);
+	uint64_t a, b;
+
+	if (len <= 16) {
+		wy_small(p, len, &a, &b);
+	} else {
+		size_t i = len;
+
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+
+			do {
+				seed = wy_mix(wy_r8(p) ^ WY_S1, wy_r8(p + 8) ^ seed);
+				see1 = wy_mix(wy_r8(p + 16) ^ WY_S2, wy_r8(p + 24) ^ see1);
+				see2 = wy_mix(wy_r8(p + 32) ^ WY_S3, wy_r8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = wy_mix(wy_r8(p) ^ WY_S1, wy_r8(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+		a = wy_r8(p + i - 16);
+		b = wy_r8(p + i - 8);
+	}
+	a ^= WY_S1;
+	b ^= seed;
+	wy_mum(&a, &b);
+	return wy_mix(a ^ WY_S0 ^ len, b ^ WY_S1);
+}
+
+#ifdef __x86_64__
+static inline uint64_t fmix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/*
+ * SSE4.2: two CRC32C lanes, the second over word-swapped input so the lanes
+ * are independent, joined and finalized with fmix64 since CRC is linear.
+ */
+__attribute__((target("sse4.2")))
+static uint64_t hash_crc32c(const char *key, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)key;
+	uint64_t lo = _mm_crc32_u64((uint32_t)WY_S0, len);
+	uint64_t hi = _mm_crc32_u64((uint32_t)WY_S1, len);
+	uint64_t w;
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		w = wy_r8(p + i);
+		lo = _mm_crc32_u64(lo, w);
+		hi = _mm_crc32_u64(hi, (w >> 32) | (w << 32));
+	}
+	if (i < len) {
+		/* the length went in first, so re-reading overlapped bytes is fine */
+		if (len >= 8)
+			w = wy_r8(p + len - 8);
+		else if (len >= 4)
+			w = (wy_r4(p) << 32) | wy_r4(p + len - 4);
+		else
+			w = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+		lo = _mm_crc32_u64(lo, w);
+		hi = _mm_crc32_u64(hi, (w >> 32) | (w << 32));
+	}
+	return fmix64(hi << 32 | lo);
+}
+
+/*
+ * AES-NI: one round per 16-byte block, two more to finish diffusion.  The
+ * last block of a longer key overlaps the one before it; the length is mixed
+ * in up front so that stays unambiguous.
+ */
+__attribute__((target("aes")))
+static uint64_t hash_aes(const char *key, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)key;
+	__m128i k0 = _mm_set_epi64x(WY_S0, WY_S1);
+	__m128i k1 = _mm_set_epi64x(WY_S2, WY_S3);
+	__m128i h = _mm_set_epi64x(len, WY_S2);
+	__m128i last;
+	size_t i;
+
+	if (len <= 16) {
+		uint64_t a, b;
+
+		wy_small(p, len, &a, &b);
+		last = _mm_set_epi64x(b, a);
+	} else {
+		for (i = 0; i + 16 < len; i += 16)
+			h = _mm_aesenc_si128(_mm_xor_si128(h, _mm_loadu_si128((const __m128i*)(p + i))), k0);
+		last = _mm_loadu_si128((const __m128i*)(p + len - 16));
+	}
+	h = _mm_aesenc_si128(_mm_xor_si128(h, last), k0);
+	h = _mm_aesenc_si128(h, k1);
+	h = _mm_aesenc_si128(h, k0);
+	return (uint64_t)_mm_cvtsi128_si64(h) ^ (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(h, h));
+}
+
+static int cpu_has(unsigned int ecx_bit)
+{
+	unsigned int a, b, c, d;
+
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+		return 0;
+	return (c & ecx_bit) != 0;
+}
+#endif
+
+/* The kernel for 'kind', or NULL when this CPU cannot run it. */
+static uint64_t (*hash_kernel(uint64_t kind))(const char *, size_t)
+{
+	switch (kind) {
+	case PMKV_HASH_PORTABLE:
+		return hash_wy;
+#ifdef __x86_64__
+	case PMKV_HASH_CRC32C:
+		return cpu_has(bit_SSE4_2) ? hash_crc32c : NULL;
+	case PMKV_HASH_AES:
+		return cpu_has(bit_AES) ? hash_aes : NULL;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+/* What PMKV_HASH_AUTO means on this CPU, fastest first. */
+static uint64_t hash_auto(void)
+{
+	if (hash_kernel(PMKV_HASH_AES) != NULL)
+		return PMKV_HASH_AES;
+	if (hash_kernel(PMKV_HASH_CRC32C) != NULL)
+		return PMKV_HASH_CRC32C;
+	return PMKV_HASH_PORTABLE;
+}
+
+static inline size_t val_space(size_t val_size)
+{
+	return val_size <= sizeof(uint64_t) ? sizeof(uint64_t) : (val_size + 7) & ~(size_t)7;
+}
+
+static inline size_t rec_size(size_t key_size, size_t val_size)
+{
+	return sizeof(struct pm_record) + val_space(val_size) + ((key_size + 7) & ~(size_t)7);
+}
+
+static inline struct pm_record *rec_at(struct kv *kv, uint64_t off)
+{
+	return pm_ptr(kv, off);
+}
+
+static inline const char *rec_key(const struct pm_record *rec)
+{
+	return rec->data + val_space(rec->val_size);
+}
+
+static inline struct shard *shard_of(struct kv *kv, uint64_t hash)
+{
+	return &kv->shard[hash >> (64 - SHARD_BITS)];
+}
+
+static inline size_t table_size(struct kv *kv, uint64_t nbuckets)
+{
+	size_t size = sizeof(struct pm_table) + nbuckets * sizeof(struct pm_bucket);
+
+	if (kv->fixed_key)
+		size += nbuckets * BUCKET_SLOTS * sizeof(struct pm_key);
+	return size;
+}
+
+/* Inline key of the slot 'slot' of table 't' */
+static inline struct pm_key *slot_key(struct pm_table *t, const uint64_t *slot)
+{
+	struct pm_key *keys = (struct pm_key *)&t->buckets[t->nbuckets];
+	size_t b = ((const char *)slot - (const char *)t->buckets) / sizeof(struct pm_bucket);
+	size_t i = slot - t->buckets[b].slot;
+
+	return &keys[b * BUCKET_SLOTS + i];
+}
+
+/* NUMA */
+
+/* Pin the calling thread to the CPUs sysfs lists for 'node'. */
+static int bind_node(int node)
+{
+	char path[64];
+	char list[4096];
+	cpu_set_t set;
+	char *p;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return 1;
+	p = fgets(list, sizeof(list), f);
+	fclose(f);
+	if (p == NULL)
+		return 1;
+
+	/* "0-15,32-47" */
+	CPU_ZERO(&set);
+	while (*p >= '0' && *p <= '9') {
+		long lo = strtol(p, &p, 10);
+		long hi = lo;
+
+		if (*p == '-')
+			hi = strtol(p + 1, &p, 10);
+		for (; lo <= hi && lo < CPU_SETSIZE; lo++)
+			CPU_SET(lo, &set);
+		if (*p == ',')
+			p++;
+	}
+	if (CPU_COUNT(&set) == 0)
+		return 1;
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0;
+}
+
+static inline int node_of(const struct db *db, uint64_t hash)
+{
+	return (int)((((hash * NODE_MIX) >> 32) * (uint64_t)db->nodes) >> 32);
+}
+
+static inline void numa_account(struct kv *kv, struct shard *sh)
+{
+	if (thread_node >= 0)
+		__atomic_fetch_add(thread_node == kv->node ? &sh->numa_local : &sh->numa_remote,
+				1, __ATOMIC_RELAXED);
+}
+
+/* DRAM filter */
+
+static int filter_init(struct filter *f, uint64_t nbuckets)
+{
+	uint64_t nblocks = nbuckets / FILTER_BUCKETS;
+
+	f->block = aligned_alloc(FILTER_BLOCK, nblocks * FILTER_BLOCK);
+	if (f->block == NULL)
+		return 1;
+	memset(f->block, 0, nblocks * FILTER_BLOCK);
+	f->shift = 64 - __builtin_ctzll(nblocks);
+	return 0;
+}
+
+static void filter_free(struct filter *f)
+{
+	free(f->block);
+	f->block = NULL;
+}
+
+static inline size_t filter_bytes(const struct filter *f)
+{
+	return f->block != NULL ? (FILTER_BLOCK << (64 - f->shift)) : 0;
+}
+
+/*
+ * The block comes from all the hash bits; the counters from bits 24-51, which
+ * neither the bucket number of any realistic table nor the fingerprint use.
+ */
+static inline uint8_t *filter_block(const struct filter *f, uint64_t hash)
+{
+	return f->block + ((hash * FILTER_MIX) >> f->shift) * FILTER_BLOCK;
+}
+
+static void filter_add(struct filter *f, uint64_t hash, int delta)
+{
+	uint8_t *block = filter_block(f, hash);
+	uint64_t bits = hash >> 24;
+	int i;
+
+	for (i = 0; i < FILTER_K; i++, bits >>= 7) {
+		uint8_t *c = &block[(bits & 127) >> 1];
+		unsigned int shift = (bits & 1) * 4;
+		unsigned int v = (*c >> shift) & FILTER_MAX;
+
+		if (v == FILTER_MAX || (delta < 0 && v == 0))
+			continue;
+		*c = (*c & ~(FILTER_MAX << shift)) | ((v + delta) << shift);
+	}
+}
+
+static int filter_test(const struct filter *f, uint64_t hash)
+{
+	const uint8_t *block = filter_block(f, hash);
+	uint64_t bits = hash >> 24;
+	int i;
+
+	for (i = 0; i < FILTER_K; i++, bits >>= 7) {
+		if (((block[(bits & 127) >> 1] >> ((bits & 1) * 4)) & FILTER_MAX) == 0)
+			return 0;
+	}
+	return 1;
+}
+
+/* chunk descriptors */
+
+static inline struct chunk_desc *chunk_desc_at(struct kv *kv, uint32_t idx)
+{
+	return &kv->chunk_dir[idx / CHUNK_PAGE_SIZE][idx % CHUNK_PAGE_SIZE];
+}
+
+static uint32_t chunk_desc_get(struct kv *kv)
+{
+	uint32_t idx = CHUNK_NONE;
+
+	pthread_mutex_lock(&kv->chunk_lock);
+	if (kv->free_desc != CHUNK_NONE) {
+		idx = kv->free_desc;
+		kv->free_desc = chunk_desc_at(kv, idx)->next_free;
+	} else if (kv->nchunk_desc < CHUNK_PAGE_SIZE * CHUNK_DIR_PAGES) {
+		uint32_t page = kv->nchunk_desc / CHUNK_PAGE_SIZE;
+		if (kv->chunk_dir[page] == NULL)
+			kv->chunk_dir[page] = calloc(CHUNK_PAGE_SIZE, sizeof(struct chunk_desc));
+		if (kv->chunk_dir[page] != NULL)
+			idx = kv->nchunk_desc++;
+	}
+	pthread_mutex_unlock(&kv->chunk_lock);
+	return idx;
+}
+
+static void chunk_desc_put(struct kv *kv, uint32_t idx)
+{
+	struct chunk_desc *c = chunk_desc_at(kv, idx);
+
+	pthread_mutex_lock(&kv->chunk_lock);
+	c->off = 0;
+	c->next_free = kv->free_desc;
+	kv->free_desc = idx;
+	pthread_mutex_unlock(&kv->chunk_lock);
+}
+
+struct chunk_args {
+	uint64_t size;
+	uint32_t shard;
+	uint32_t vidx;
+};
+
+static int chunk_construct(PMEMobjpool *pop, void *ptr, void *arg)
+{
+	struct pm_chunk *chunk = ptr;
+	struct chunk_args *args = arg;
+
+	chunk->size = args->size;
+	chunk->shard = args->shard;
+	chunk->vidx = args->vidx;
+	pmemobj_persist(pop, chunk, sizeof(*chunk));
+	return 0;
+}
+
+static struct chunk_desc *chunk_alloc(struct kv *kv, uint32_t shard, uint64_t size)
+{
+	struct chunk_args args = { size, shard, chunk_desc_get(kv) };
+	struct chunk_desc *c;
+	PMEMoid oid;
+
+	if (args.vidx == CHUNK_NONE)
+		return NULL;
+	if (pmemobj_alloc(kv->pop, &oid, size, PM_TYPE_CHUNK, chunk_construct, &args)) {
+		chunk_desc_put(kv, args.vidx);
+		return NULL;
+	}
+	c = chunk_desc_at(kv, args.vidx);
+	c->off = oid.off;
+	c->size = size;
+	c->live = 0;
+	c->shard = shard;
+	return c;
+}
+
+static void chunk_free(struct kv *kv, struct chunk_desc *c)
+{
+	struct pm_chunk *chunk = pm_ptr(kv, c->off);
+	PMEMoid oid = pm_oid(kv, c->off);
+
+	pmemobj_free(&oid);
+	chunk_desc_put(kv, chunk->vidx);
+	__atomic_fetch_add(&kv->chunks_reclaimed, 1, __ATOMIC_RELAXED);
+}
+
+static inline struct chunk_desc *chunk_of(struct kv *kv, const struct pm_record *rec)
+{
+	struct pm_chunk *chunk = (struct pm_chunk *)((char *)rec - rec->chunk_pos);
+	return chunk_desc_at(kv, chunk->vidx);
+}
+
+/* Account for a record that is no longer referenced by the index. */
+static void record_dead(struct kv *kv, struct shard *sh, uint64_t off)
+{
+	struct pm_record *rec = rec_at(kv, off);
+	struct chunk_desc *c = chunk_of(kv, rec);
+
+	c->live -= rec_size(rec->key_size, rec->val_size);
+	if (c->live == 0 && c != sh->log)
+		chunk_free(kv, c);
+}
+
+/* Append a record to the shard log and persist it; returns its offset. */
+static uint64_t log_append(struct kv *kv, struct shard *sh, uint64_t hash,
+		const char *key, size_t key_size, const char *val, size_t val_size, int codec)
+{
+	size_t size = rec_size(key_size, val_size);
+	uint32_t shard = sh - kv->shard;
+	struct chunk_desc *c;
+	struct pm_record *rec;
+	uint64_t pos;
+
+	if (size > CHUNK_SIZE - sizeof(struct pm_chunk)) {
+		/* large records get a chunk of their own */
+		c = chunk_alloc(kv, shard, sizeof(struct pm_chunk) + size);
+		if (c == NULL)
+			return 0;
+		pos = sizeof(struct pm_chunk);
+	} else {
+		if (sh->log == NULL || sh->log_tail + size > sh->log->size) {
+			struct chunk_desc *old = sh->log;
+
+			c = chunk_alloc(kv, shard, CHUNK_SIZE);
+			if (c == NULL)
+				return 0;
+			sh->log = c;
+			sh->log_tail = sizeof(struct pm_chunk);
+			if (old != NULL && old->live == 0)
+				chunk_free(kv, old);
+		}
+		c = sh->log;
+		pos = sh->log_tail;
+		sh->log_tail += size;
+	}
+
+	rec = pm_ptr(kv, c->off + pos);
+	rec->hash = hash;
+	rec->key_size = key_size;
+	rec->val_size = val_size;
+	rec->chunk_pos = pos;
+	rec->codec = codec;
+	memset(rec->reserved, 0, sizeof(rec->reserved));
+	memcpy(rec->data, val, val_size);
+	memcpy(rec->data + val_space(val_size), key, key_size);
+	persist(kv, rec, size);
+
+	c->live += size;
+	return c->off + pos;
+}
+
+/* hash index */
+
+/* The hash bits just below the shard bits; bucket numbers come from the bottom. */
+static inline uint8_t hash_fp(uint64_t hash)
+{
+	return (uint8_t)(hash >> (64 - SHARD_BITS - 8));
+}
+
+/* Bitmap of the slots whose fingerprint is 'fp'. */
+static inline unsigned bucket_match(const struct pm_bucket *bucket, uint8_t fp)
+{
+#ifdef __SSE2__
+	__m128i line = _mm_loadl_epi64((const __m128i*)bucket);
+	__m128i eq = _mm_cmpeq_epi8(line, _mm_set1_epi8((char)fp));
+
+	return ((unsigned)_mm_movemask_epi8(eq) >> 1) & ((1U << BUCKET_SLOTS) - 1);
+#else
+	unsigned match = 0;
+	int i;
+
+	for (i = 0; i < BUCKET_SLOTS; i++)
+		match |= (unsigned)(bucket->fp[i] == fp) << i;
+	return match;
+#endif
+}
+
+/* table_find() for fixed-key pools: keys are matched in the index itself. */
+static uint64_t *table_find_fixed(struct pm_table *t, uint64_t mask, uint64_t hash,
+		const char *key)
+{
+	struct pm_key *keys = (struct pm_key *)&t->buckets[t->nbuckets];
+	uint64_t b = hash & mask;
+	uint8_t fp = hash_fp(hash);
+	uint64_t w0, w1;
+	uint64_t n;
+	unsigned match;
+	int i;
+
+	memcpy(&w0, key, sizeof(w0));
+	memcpy(&w1, key + sizeof(w0), sizeof(w1));
+	for (n = 0; n <= mask; n++) {
+		struct pm_bucket *bucket = &t->buckets[b];
+		struct pm_key *k = &keys[b * BUCKET_SLOTS];
+
+		for (match = bucket_match(bucket, fp); match != 0; match &= match - 1) {
+			i = __builtin_ctz(match);
+			if (bucket->slot[i] != 0 && k[i].w[0] == w0 && k[i].w[1] == w1)
+				return &bucket->slot[i];
+		}
+		if (!(bucket->flags & BUCKET_OVERFLOW))
+			return NULL;
+		b = (b + 1) & mask;
+	}
+	return NULL;
+}
+
+static uint64_t *table_find(struct kv *kv, struct pm_table *t, uint64_t mask,
+		uint64_t hash, const char *key, size_t key_size)
+{
+	uint64_t b = hash & mask;
+	uint8_t fp = hash_fp(hash);
+	uint64_t n;
+	unsigned match;
+	int i;
+
+	if (kv->fixed_key)
+		return key_size == PMKV_FIXED_KEY_SIZE ? table_find_fixed(t, mask, hash, key) : NULL;
+	for (n = 0; n <= mask; n++) {
+		struct pm_bucket *bucket = &t->buckets[b];
+
+		for (match = bucket_match(bucket, fp); match != 0; match &= match - 1) {
+			struct pm_record *rec;
+
+			i = __builtin_ctz(match);
+			if (bucket->slot[i] == 0)
+				continue;
+			rec = rec_at(kv, bucket->slot[i]);
+			if (rec->hash == hash && rec->key_size == key_size &&
+			    memcmp(rec_key(rec), key, key_size) == 0)
+				return &bucket->slot[i];
+		}
+		if (!(bucket->flags & BUCKET_OVERFLOW))
+			return NULL;
+		b = (b + 1) & mask;
+	}
+	return NULL;
+}
+
+/*
+ * Find an empty slot for a new entry, marking every full bucket passed on the
+ * way so lookups keep probing past it.  The overflow marks are persisted
+ * before the caller publishes the slot; the slot's fingerprint is set here.
+ * In a fixed-key pool the inline key is written and flushed too, and the
+ * caller must drain before publishing.
+ */
+static uint64_t *table_free_slot(struct kv *kv, struct pm_table *t, uint64_t mask,
+		uint64_t hash, const char *key)
+{
+	uint64_t b = hash & mask;
+	int i;
+
+	for (;;) {
+		struct pm_bucket *bucket = &t->buckets[b];
+
+		for (i = 0; i < BUCKET_SLOTS; i++) {
+			if (bucket->slot[i] == 0) {
+				bucket->fp[i] = hash_fp(hash);
+				if (kv->fixed_key) {
+					struct pm_key *k = slot_key(t, &bucket->slot[i]);
+
+					memcpy(k, key, sizeof(*k));
+					pmemobj_flush(kv->pop, k, sizeof(*k));
+				}
+				return &bucket->slot[i];
+			}
+		}
+		if (!(bucket->flags & BUCKET_OVERFLOW)) {
+			bucket->flags |= BUCKET_OVERFLOW;
+			persist(kv, &bucket->flags, sizeof(bucket->flags));
+		}
+		b = (b + 1) & mask;
+	}
+}
+
+/*
+ * While a resize is running, entries whose home bucket in the old table is
+ * below the migration cursor live in the new table and all others are still
+ * in the old one.
+ */
+static inline int shard_migrated(struct shard *sh, uint64_t hash)
+{
+	return sh->next != NULL && (hash & sh->mask) < sh->migrate;
+}
+
+static uint64_t *shard_lookup(struct kv *kv, struct shard *sh, uint64_t hash,
+		const char *key, size_t key_size)
+{
+	if (shard_migrated(sh, hash))
+		return table_find(kv, sh->next, sh->next_mask, hash, key, key_size);
+	return table_find(kv, sh->table, sh->mask, hash, key, key_size);
+}
+
+/* Look a key up behind the shard filter, counting how the filter fared. */
+static uint64_t *shard_find(struct kv *kv, struct shard *sh, uint64_t hash,
+		const char *key, size_t key_size)
+{
+	uint64_t *slot;
+
+	if (!filter_test(&sh->filter, hash)) {
+		__atomic_fetch_add(&sh->filter_neg, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	slot = shard_lookup(kv, sh, hash, key, key_size);
+	if (slot == NULL)
+		__atomic_fetch_add(&sh->filter_fp, 1, __ATOMIC_RELAXED);
+	return slot;
+}
+
+/* Account an entry added to (+1) or dropped from (-1) the shard index. */
+static void shard_filter_add(struct shard *sh, uint64_t hash, int delta)
+{
+	filter_add(&sh->filter, hash, delta);
+	if (shard_migrated(sh, hash))
+		filter_add(&sh->next_filter, hash, delta);
+}
+
+static uint64_t *shard_free_slot(struct kv *kv, struct shard *sh, uint64_t hash,
+		const char *key)
+{
+	if (shard_migrated(sh, hash))
+		return table_free_slot(kv, sh->next, sh->next_mask, hash, key);
+	return table_free_slot(kv, sh->table, sh->mask, hash, key);
+}
+
+static inline int shard_full(struct shard *sh)
+{
+	return (sh->count + 1) * 100 > (sh->mask + 1) * BUCKET_SLOTS * MAX_LOAD_PCT;
+}
+
+static inline int shard_sparse(struct shard *sh)
+{
+	return sh->mask + 1 > INIT_BUCKETS &&
+	       sh->count * 100 < (sh->mask + 1) * BUCKET_SLOTS * MIN_LOAD_PCT;
+}
+
+/* Smallest index that holds 'count' entries at FIT_LOAD_PCT. */
+static uint64_t fit_buckets(uint64_t count)
+{
+	uint64_t n = INIT_BUCKETS;
+
+	while (count * 100 > n * BUCKET_SLOTS * FIT_LOAD_PCT)
+		n *= 2;
+	return n;
+}
+
+/*
+ * Start moving the shard index into a table of 'nbuckets' buckets, larger or
+ * smaller than the current one.  Nothing is copied here: the new table is
+ * allocated in the spare table[] slot and the buckets are migrated a few at
+ * a time by shard_migrate().
+ */
+static int shard_resize_start(struct kv *kv, struct shard *sh, uint64_t nbuckets)
+{
+	struct pm_shard *ps = sh->pm;
+	uint64_t cur = ps->state & RESIZE_CUR;
+	struct pm_table *t;
+
+	if (filter_init(&sh->next_filter, nbuckets))
+		return 1;
+	if (pmemobj_zalloc(kv->pop, &ps->table[!cur], table_size(kv, nbuckets), PM_TYPE_TABLE)) {
+		filter_free(&sh->next_filter);
+		return 1;
+	}
+	t = pmemobj_direct(ps->table[!cur]);
+	t->nbuckets = nbuckets;
+	persist(kv, &t->nbuckets, sizeof(t->nbuckets));
+	ps->state = cur | (1 << RESIZE_SHIFT);
+	persist(kv, &ps->state, sizeof(ps->state));
+
+	sh->next = t;
+	sh->next_mask = nbuckets - 1;
+	sh->migrate = 0;
+	return 0;
+}
+
+/*
+ * Move every entry whose home is old bucket 'home' to the new table.  Each
+ * entry is published in the new table before it is cleared from the old
+ * one, so a crash can at worst leave it in both; migrate_repair() resolves
+ * that at open.
+ */
+static void migrate_bucket(struct kv *kv, struct shard *sh, uint64_t home)
+{
+	uint64_t b = home;
+	uint64_t n;
+	int i;
+
+	for (n = 0; n <= sh->mask; n++) {
+		struct pm_bucket *bucket = &sh->table->buckets[b];
+
+		for (i = 0; i < BUCKET_SLOTS; i++) {
+			uint64_t off = bucket->slot[i];
+			uint64_t hash;
+			uint64_t *slot;
+
+			if (off == 0)
+				continue;
+			hash = rec_at(kv, off)->hash;
+			if ((hash & sh->mask) != home)
+				continue;
+			if (kv->fixed_key) {
+				slot = table_free_slot(kv, sh->next, sh->next_mask, hash,
+						(const char *)slot_key(sh->table, &bucket->slot[i]));
+				pmemobj_drain(kv->pop);
+			} else {
+				slot = table_free_slot(kv, sh->next, sh->next_mask, hash, NULL);
+			}
+			*slot = off;
+			persist(kv, slot, sizeof(*slot));
+			/* recover() builds the filters after finishing a bucket */
+			if (sh->next_filter.block != NULL)
+				filter_add(&sh->next_filter, hash, 1);
+			crash_point(PMKV_CRASH_MIGRATE);
+			bucket->slot[i] = 0;
+			persist(kv, &bucket->slot[i], sizeof(bucket->slot[i]));
+		}
+		if (!(bucket->flags & BUCKET_OVERFLOW))
+			break;
+		b = (b + 1) & sh->mask;
+	}
+}
+
+/* Drop old-table copies of entries a crash left in both tables. */
+static void migrate_repair(struct kv *kv, struct shard *sh)
+{
+	uint64_t b = sh->migrate;
+	uint64_t n;
+	int i;
+
+	for (n = 0; n <= sh->mask; n++) {
+		struct pm_bucket *bucket = &sh->table->buckets[b];
+
+		for (i = 0; i < BUCKET_SLOTS; i++) {
+			struct pm_record *rec;
+
+			if (bucket->slot[i] == 0)
+				continue;
+			rec = rec_at(kv, bucket->slot[i]);
+			if ((rec->hash & sh->mask) != sh->migrate)
+				continue;
+			if (table_find(kv, sh->next, sh->next_mask, rec->hash,
+					rec_key(rec), rec->key_size) != NULL) {
+				bucket->slot[i] = 0;
+				persist(kv, &bucket->slot[i], sizeof(bucket->slot[i]));
+			}
+		}
+		if (!(bucket->flags & BUCKET_OVERFLOW))
+			break;
+		b = (b + 1) & sh->mask;
+	}
+}
+
+/* Migrate up to 'nbuckets' old buckets; the caller holds the shard lock. */
+static void shard_migrate(struct kv *kv, struct shard *sh, unsigned int nbuckets)
+{
+	struct pm_shard *ps = sh->pm;
+	uint64_t cur = ps->state & RESIZE_CUR;
+
+	while (sh->next != NULL && nbuckets-- > 0) {
+		migrate_bucket(kv, sh, sh->migrate);
+		sh->migrate++;
+		if (sh->migrate <= sh->mask) {
+			ps->state = cur | ((sh->migrate + 1) << RESIZE_SHIFT);
+			persist(kv, &ps->state, sizeof(ps->state));
+			continue;
+		}
+
+		/* all moved: the new table becomes live with one store */
+		ps->state = !cur;
+		persist(kv, &ps->state, sizeof(ps->state));
+		pmemobj_free(&ps->table[cur]);
+
+		sh->table = sh->next;
+		sh->mask = sh->next_mask;
+		sh->next = NULL;
+		sh->migrate = 0;
+		filter_free(&sh->filter);
+		sh->filter = sh->next_filter;
+		sh->next_filter.block = NULL;
+	}
+}
+
+/*
+ * Overwrite a value of the same size without allocating.  Values of up to 8
+ * bytes live in one aligned word and are replaced with a single atomic store;
+ * larger ones are protected by the shard undo slot.
+ */
+static int update_in_place(struct kv *kv, struct shard *sh, uint64_t off,
+		const char *val, size_t val_size)
+{
+	struct pm_record *rec = rec_at(kv, off);
+	struct pm_undo *undo = &sh->pm->undo;
+
+	if (val_size <= sizeof(uint64_t)) {
+		uint64_t word = 0;
+
+		memcpy(&word, val, val_size);
+		__atomic_store_n((uint64_t *)rec->data, word, __ATOMIC_RELAXED);
+		persist(kv, rec->data, sizeof(word));
+		return 0;
+	}
+	if (val_size > UNDO_MAX)
+		return 1;
+
+	memcpy(undo->data, rec->data, val_size);
+	undo->size = val_size;
+	persist(kv, &undo->size, sizeof(undo->size) + val_size);
+	undo->rec = off;
+	persist(kv, &undo->rec, sizeof(undo->rec));
+
+	pmemobj_memcpy_persist(kv->pop, rec->data, val, val_size);
+	crash_point(PMKV_CRASH_UNDO);
+
+	undo->rec = 0;
+	persist(kv, &undo->rec, sizeof(undo->rec));
+	return 0;
+}
+
+/* log compaction */
+
+/*
+ * Move the live records of a sealed chunk to the head of its shard log.  The
+ * shard lock is dropped every COMPACT_BATCH bytes so foreground operations
+ * are only ever delayed by one batch, and the batches are paced to
+ * COMPACT_RATE unless the log is mostly garbage.
+ */
+static void compact_chunk(struct kv *kv, struct chunk_desc *c, uint64_t off,
+		uint32_t shard, int urgent)
+{
+	struct shard *sh = &kv->shard[shard];
+	uint64_t pos = sizeof(struct pm_chunk);
+
+	while (!__atomic_load_n(&kv->compact_stop, __ATOMIC_RELAXED)) {
+		size_t moved = 0;
+		int done = 0;
+
+		pthread_rwlock_wrlock(&sh->lock);
+		if (c->off != off || c->shard != shard || c == sh->log) {
+			pthread_rwlock_unlock(&sh->lock);
+			return;
+		}
+		while (moved < COMPACT_BATCH) {
+			struct pm_record *rec = pm_ptr(kv, off + pos);
+			uint64_t *slot;
+			size_t size;
+
+			/* records are contiguous; whatever follows the last one is stale */
+			if (pos + sizeof(*rec) > c->size || rec->chunk_pos != pos ||
+			    rec->val_size > MAX_VAL_LEN ||
+			    rec_size(rec->key_size, rec->val_size) > c->size - pos) {
+				done = 1;
+				break;
+			}
+			size = rec_size(rec->key_size, rec->val_size);
+			slot = shard_lookup(kv, sh, rec->hash, rec_key(rec), rec->key_size);
+			if (slot != NULL && *slot == off + pos) {
+				uint64_t to = log_append(kv, sh, rec->hash, rec_key(rec),
+						rec->key_size, rec->data, rec->val_size, rec->codec);
+
+				if (to == 0) {
+					done = 1;
+					break;
+				}
+				__atomic_store_n(slot, to, __ATOMIC_RELEASE);
+				persist(kv, slot, sizeof(*slot));
+				moved += size;
+				record_dead(kv, sh, off + pos);
+				if (c->off != off) {
+					/* last live record gone, the chunk was freed */
+					__atomic_fetch_add(&kv->compact_chunks, 1, __ATOMIC_RELAXED);
+					done = 1;
+					break;
+				}
+			}
+			pos += size;
+		}
+		pthread_rwlock_unlock(&sh->lock);
+
+		__atomic_fetch_add(&kv->compact_moved, moved, __ATOMIC_RELAXED);
+		if (done)
+			return;
+		if (!urgent) {
+			struct timespec ts;
+			uint64_t ns = moved * 1000000000ULL / COMPACT_RATE;
+
+			ts.tv_sec = ns / 1000000000ULL;
+			ts.tv_nsec = ns % 1000000000ULL;
+			nanosleep(&ts, NULL);
+		}
+	}
+}
+
+/* Run the shard's pending resize to completion, one batch per lock hold. */
+static void shard_migrate_all(struct kv *kv, struct shard *sh)
+{
+	while (__atomic_load_n(&sh->next, __ATOMIC_RELAXED) != NULL &&
+	       !__atomic_load_n(&kv->compact_stop, __ATOMIC_RELAXED)) {
+		pthread_rwlock_wrlock(&sh->lock);
+		shard_migrate(kv, sh, RESIZE_BG_BATCH);
+		pthread_rwlock_unlock(&sh->lock);
+	}
+}
+
+/* Finish resizes that foreground writes alone would leave half done. */
+static void migrate_pass(struct kv *kv)
+{
+	int s;
+
+	for (s = 0; s < NSHARDS; s++)
+		shard_migrate_all(kv, &kv->shard[s]);
+}
+
+/*
+ * Evacuate sealed chunks that are at most 'live_pct' percent live.  The
+ * background pass is throttled unless the log is mostly garbage; an explicit
+ * pmkv_compact() never is.
+ */
+static void compact_pass(struct kv *kv, int live_pct, int throttle)
+{
+	uint32_t n = __atomic_load_n(&kv->nchunk_desc, __ATOMIC_ACQUIRE);
+	uint64_t total = 0, live = 0;
+	uint32_t idx;
+	int urgent;
+
+	for (idx = 0; idx < n; idx++) {
+		struct chunk_desc *c = chunk_desc_at(kv, idx);
+
+		if (__atomic_load_n(&c->off, __ATOMIC_RELAXED) == 0)
+			continue;
+		total += c->size;
+		live += __atomic_load_n(&c->live, __ATOMIC_RELAXED);
+	}
+	if (total == 0)
+		return;
+	urgent = !throttle || (total - live) * 100 > total * COMPACT_URGENT_PCT;
+
+	for (idx = 0; idx < n; idx++) {
+		struct chunk_desc *c = chunk_desc_at(kv, idx);
+		uint64_t off = __atomic_load_n(&c->off, __ATOMIC_RELAXED);
+
+		if (__atomic_load_n(&kv->compact_stop, __ATOMIC_RELAXED))
+			return;
+		if (off == 0 || c == kv->shard[c->shard].log ||
+		    __atomic_load_n(&c->live, __ATOMIC_RELAXED) * 100 > c->size * live_pct)
+			continue;
+		compact_chunk(kv, c, off, c->shard, urgent);
+	}
+}
+
+static void *compactor_main(void *arg)
+{
+	struct kv *kv = arg;
+
+	/* keep relocation traffic on the node that owns the pool */
+	if (kv->nodes > 1)
+		bind_node(kv->node);
+	pthread_mutex_lock(&kv->compact_lock);
+	while (!kv->compact_stop) {
+		struct timespec ts;
+
+		pthread_mutex_unlock(&kv->compact_lock);
+		migrate_pass(kv);
+		compact_pass(kv, COMPACT_LIVE_PCT, 1);
+		pthread_mutex_lock(&kv->compact_lock);
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += COMPACT_INTERVAL_MS * 1000000L;
+		ts.tv_sec += ts.tv_nsec / 1000000000L;
+		ts.tv_nsec %= 1000000000L;
+		if (!kv->compact_stop)
+			pthread_cond_timedwait(&kv->compact_cv, &kv->compact_lock, &ts);
+	}
+	pthread_mutex_unlock(&kv->compact_lock);
+	return NULL;
+}
+
+/* open and recovery */
+
+#define POOLSET_SIG		"PMEMPOOLSET"
+
+static int is_poolset(const char *path)
+{
+	char sig[sizeof(POOLSET_SIG) - 1];
+	FILE *f = fopen(path, "r");
+	int ret;
+
+	if (f == NULL)
+		return 0;
+	ret = fread(sig, 1, sizeof(sig), f) == sizeof(sig) &&
+	      memcmp(sig, POOLSET_SIG, sizeof(sig)) == 0;
+	fclose(f);
+	return ret;
+}
+
+static size_t file_bytes(const char *path)
+{
+	struct stat st;
+
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : 0;
+}
+
+/* Part files libpmemobj created in a poolset directory part */
+static size_t dir_part_bytes(const char *dir)
+{
+	char path[PATH_MAX];
+	struct dirent *e;
+	size_t bytes = 0;
+	DIR *d = opendir(dir);
+
+	if (d == NULL)
+		return 0;
+	while ((e = readdir(d)) != NULL) {
+		size_t len = strlen(e->d_name);
+
+		if (len < 5 || strcmp(e->d_name + len - 5, ".pmem") != 0)
+			continue;
+		if (snprintf(path, sizeof(path), "%s/%s", dir, e->d_name) < (int)sizeof(path))
+			bytes += file_bytes(path);
+	}
+	closedir(d);
+	return bytes;
+}
+
+/*
+ * Bytes of the files behind a pool: the file itself, or the parts of a
+ * poolset's primary replica as they are on disk.
+ */
+static size_t pool_bytes(const char *path)
+{
+	char line[PATH_MAX + 64];
+	char part[PATH_MAX];
+	size_t bytes = 0;
+	struct stat st;
+	FILE *f;
+
+	if (!is_poolset(path))
+		return file_bytes(path);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char size[32];
+
+		if (strncmp(line, "REPLICA", 7) == 0)
+			break;
+		if (sscanf(line, "%31s %4095s", size, part) != 2 || size[0] < '0' || size[0] > '9')
+			continue;
+		if (stat(part, &st) == 0 && S_ISDIR(st.st_mode))
+			bytes += dir_part_bytes(part);
+		else
+			bytes += file_bytes(part);
+	}
+	fclose(f);
+	return bytes;
+}
+
+static int pool_init(struct kv *kv, uint64_t hash, uint64_t key_size)
+{
+	struct pm_root *root = kv->root;
+	int s;
+
+	kv->fixed_key = key_size != 0;
+	for (s = 0; s < NSHARDS; s++) {
+		struct pm_shard *ps = &root->shard[s];
+		struct pm_table *t;
+
+		pmemobj_free(&ps->table[0]);
+		pmemobj_free(&ps->table[1]);
+		if (pmemobj_zalloc(kv->pop, &ps->table[0], table_size(kv, INIT_BUCKETS), PM_TYPE_TABLE))
+			return 1;
+		t = pmemobj_direct(ps->table[0]);
+		t->nbuckets = INIT_BUCKETS;
+		persist(kv, t, sizeof(*t));
+		ps->state = 0;
+		ps->undo.rec = 0;
+		persist(kv, ps, sizeof(*ps) - sizeof(ps->undo.data));
+	}
+	root->hash = hash;
+	root->key_size = key_size;
+	root->node = kv->node;
+	root->nodes = kv->nodes;
+	persist(kv, &root->hash, sizeof(root->hash) + sizeof(root->key_size) +
+			sizeof(root->node) + sizeof(root->nodes));
+	root->version = PMKV_VERSION;
+	persist(kv, &root->version, sizeof(root->version));
+	root->magic = PMKV_MAGIC;
+	persist(kv, &root->magic, sizeof(root->magic));
+	return 0;
+}
+
+/* Recompute the fingerprints of a table that may predate the last crash. */
+static void table_fingerprint(struct kv *kv, struct pm_table *t, uint64_t mask)
+{
+	uint64_t b;
+	int i;
+
+	for (b = 0; b <= mask; b++) {
+		struct pm_bucket *bucket = &t->buckets[b];
+
+		for (i = 0; i < BUCKET_SLOTS; i++) {
+			uint8_t fp;
+
+			if (bucket->slot[i] == 0)
+				continue;
+			fp = hash_fp(rec_at(kv, bucket->slot[i])->hash);
+			if (bucket->fp[i] != fp)
+				bucket->fp[i] = fp;
+		}
+	}
+}
+
+/* Add the entries of one index table to the shard count and chunk live bytes. */
+static void table_account(struct kv *kv, struct shard *sh, struct pm_table *t, uint64_t mask)
+{
+	uint64_t b;
+	int i;
+
+	for (b = 0; b <= mask; b++) {
+		struct pm_bucket *bucket = &t->buckets[b];
+
+		for (i = 0; i < BUCKET_SLOTS; i++) {
+			struct pm_record *rec;
+
+			if (bucket->slot[i] == 0)
+				continue;
+			rec = rec_at(kv, bucket->slot[i]);
+			chunk_of(kv, rec)->live += rec_size(rec->key_size, rec->val_size);
+			filter_add(&sh->filter, rec->hash, 1);
+			if (t == sh->next)
+				filter_add(&sh->next_filter, rec->hash, 1);
+			sh->count++;
+		}
+	}
+}
+
+static int recover(struct kv *kv)
+{
+	PMEMoid oid;
+	uint32_t idx;
+	int s;
+
+	for (s = 0; s < NSHARDS; s++) {
+		struct shard *sh = &kv->shard[s];
+		struct pm_shard *ps = &kv->root->shard[s];
+		uint64_t cur = ps->state & RESIZE_CUR;
+
+		if (ps->undo.rec != 0) {
+			struct pm_record *rec = rec_at(kv, ps->undo.rec);
+
+			pmemobj_memcpy_persist(kv->pop, rec->data, ps->undo.data, ps->undo.size);
+			ps->undo.rec = 0;
+			persist(kv, &ps->undo.rec, sizeof(ps->undo.rec));
+		}
+
+		sh->pm = ps;
+		sh->table = pmemobj_direct(ps->table[cur]);
+		sh->mask = sh->table->nbuckets - 1;
+		table_fingerprint(kv, sh->table, sh->mask);
+
+		if (!OID_IS_NULL(ps->table[!cur]) && (ps->state >> RESIZE_SHIFT) == 0) {
+			/* a resize that never started, or the drained table of a finished one */
+			pmemobj_free(&ps->table[!cur]);
+		} else if (!OID_IS_NULL(ps->table[!cur])) {
+			/*
+			 * Pick up an interrupted resize where it stopped.  The old
+			 * bucket under the cursor may be split between the tables,
+			 * where lookups would miss the moved part, so finish it first.
+			 */
+			sh->next = pmemobj_direct(ps->table[!cur]);
+			sh->next_mask = sh->next->nbuckets - 1;
+			sh->migrate = (ps->state >> RESIZE_SHIFT) - 1;
+			table_fingerprint(kv, sh->next, sh->next_mask);
+			migrate_repair(kv, sh);
+			shard_migrate(kv, sh, 1);
+		}
+
+		if (filter_init(&sh->filter, sh->mask + 1))
+			return 1;
+		if (sh->next != NULL && filter_init(&sh->next_filter, sh->next_mask + 1))
+			return 1;
+	}
+
+	for (oid = pmemobj_first(kv->pop); !OID_IS_NULL(oid); oid = pmemobj_next(oid)) {
+		struct pm_chunk *chunk;
+		struct chunk_desc *c;
+
+		if (pmemobj_type_num(oid) != PM_TYPE_CHUNK)
+			continue;
+		idx = chunk_desc_get(kv);
+		if (idx == CHUNK_NONE)
+			return 1;
+		chunk = pmemobj_direct(oid);
+		chunk->vidx = idx;
+		c = chunk_desc_at(kv, idx);
+		c->off = oid.off;
+		c->size = chunk->size;
+		c->live = 0;
+		c->shard = chunk->shard;
+	}
+
+	for (s = 0; s < NSHARDS; s++) {
+		struct shard *sh = &kv->shard[s];
+
+		table_account(kv, sh, sh->table, sh->mask);
+		if (sh->next != NULL)
+			table_account(kv, sh, sh->next, sh->next_mask);
+	}
+
+	/* chunks holding nothing reachable go back to the heap */
+	for (idx = 0; idx < kv->nchunk_desc; idx++) {
+		struct chunk_desc *c = chunk_desc_at(kv, idx);
+
+		if (c->off != 0 && c->live == 0)
+			chunk_free(kv, c);
+	}
+	return 0;
+}
+
+static void kv_free(struct kv *kv)
+{
+	int i;
+
+	for (i = 0; i < NSHARDS; i++) {
+		pthread_rwlock_destroy(&kv->shard[i].lock);
+		filter_free(&kv->shard[i].filter);
+		filter_free(&kv->shard[i].next_filter);
+	}
+	pthread_mutex_destroy(&kv->chunk_lock);
+	pthread_mutex_destroy(&kv->compact_lock);
+	pthread_cond_destroy(&kv->compact_cv);
+	for (i = 0; i < CHUNK_DIR_PAGES; i++)
+		free(kv->chunk_dir[i]);
+	cache_free(kv->cache);
+	free(kv);
+}
+
+/*
+ * The hash kernel and key size only matter to a pool being created; a reopen
+ * uses the ones recorded in the pool, whatever the options ask for.
+ */
+static int create_opts_valid(uint64_t hash, uint64_t key_size)
+{
+	return hash_kernel(hash) != NULL &&
+	       (key_size == 0 || key_size == PMKV_FIXED_KEY_SIZE);
+}
+
+static struct kv *kv_open(const char *path, size_t pool_size, int force_create,
+		const struct pmkv_options *opts, int node, int nodes)
+{
+	struct kv *kv;
+	PMEMoid root;
+	uint64_t hash = opts != NULL ? opts->hash : PMKV_HASH_AUTO;
+	uint64_t key_size = opts != NULL ? opts->key_size : 0;
+	int i;
+
+	if (hash == PMKV_HASH_AUTO)
+		hash = hash_auto();
+	/* checked before pmemobj_create() so a bad request leaves no file behind */
+	if (force_create && !create_opts_valid(hash, key_size))
+		return NULL;
+	if (opts != NULL && opts->codec != PMKV_CODEC_NONE && opts->codec != PMKV_CODEC_ZSTD)
+		return NULL;
+	if (posix_memalign((void **)&kv, 64, sizeof(*kv)))
+		return NULL;
+	memset(kv, 0, sizeof(*kv));
+	for (i = 0; i < NSHARDS; i++)
+		pthread_rwlock_init(&kv->shard[i].lock, NULL);
+	pthread_mutex_init(&kv->chunk_lock, NULL);
+	pthread_mutex_init(&kv->compact_lock, NULL);
+	pthread_cond_init(&kv->compact_cv, NULL);
+	kv->free_desc = CHUNK_NONE;
+	kv->node = node;
+	kv->nodes = nodes;
+	if (opts != NULL) {
+		kv->codec = opts->codec;
+		kv->compress_min = opts->compress_min;
+	}
+	if (opts != NULL && opts->cache_bytes > 0) {
+		kv->cache = cache_new(opts->cache_bytes / nodes);
+		if (kv->cache == NULL)
+			goto err_free;
+	}
+
+	/* libpmemobj sizes a poolset from its set file and takes no other size */
+	if (is_poolset(path))
+		pool_size = 0;
+	if (force_create)
+		kv->pop = pmemobj_create(path, PMKV_LAYOUT, pool_size, 0666);
+	else
+		kv->pop = pmemobj_open(path, PMKV_LAYOUT);
+	if (kv->pop == NULL)
+		goto err_free;
+	if (!force_create && opts != NULL && opts->grow_bytes > 0) {
+		uint64_t grow = opts->grow_bytes;
+
+		/* appends a part file to a poolset with a directory part */
+		if (pmemobj_ctl_exec(kv->pop, "heap.size.extend", &grow))
+			goto err_close;
+	}
+	kv->pool_bytes = pool_bytes(path);
+
+	root = pmemobj_root(kv->pop, sizeof(struct pm_root));
+	if (OID_IS_NULL(root))
+		goto err_close;
+	kv->uuid_lo = root.pool_uuid_lo;
+	kv->base = (char *)pmemobj_direct(root) - root.off;
+	kv->root = pmemobj_direct(root);
+
+	if (kv->root->magic == 0 &&
+	    (!create_opts_valid(hash, key_size) || pool_init(kv, hash, key_size)))
+		goto err_close;
+	if (kv->root->magic != PMKV_MAGIC || kv->root->version != PMKV_VERSION)
+		goto err_close;
+	/* a pool belongs to one place in one store layout */
+	if (kv->root->node != (uint32_t)node || kv->root->nodes != (uint32_t)nodes)
+		goto err_close;
+	/* NULL if the pool was created on a CPU with instructions this one lacks */
+	kv->hash = hash_kernel(kv->root->hash);
+	if (kv->hash == NULL)
+		goto err_close;
+	kv->fixed_key = kv->root->key_size != 0;
+	if (recover(kv))
+		goto err_close;
+	if (pthread_create(&kv->compactor, NULL, compactor_main, kv))
+		goto err_close;
+
+	return kv;
+
+err_close:
+	pmemobj_close(kv->pop);
+err_free:
+	kv_free(kv);
+	return NULL;
+}
+
+static void kv_close(struct kv *kv)
+{
+	if (kv == NULL)
+		return;
+	pthread_mutex_lock(&kv->compact_lock);
+	kv->compact_stop = 1;
+	pthread_cond_signal(&kv->compact_cv);
+	pthread_mutex_unlock(&kv->compact_lock);
+	pthread_join(kv->compactor, NULL);
+
+	pmemobj_close(kv->pop);
+	kv_free(kv);
+}
+
+static int kv_get(struct kv *kv, uint64_t hash, const char *key, size_t key_size,
+		char *out_val, size_t *out_val_size)
+{
+	struct shard *sh = shard_of(kv, hash);
+	uint64_t *slot;
+
+	numa_account(kv, sh);
+
+	pthread_rwlock_rdlock(&sh->lock);
+	if (kv->cache != NULL &&
+	    cache_get(kv->cache, hash, key, key_size, out_val, out_val_size) == 0) {
+		pthread_rwlock_unlock(&sh->lock);
+		return 0;
+	}
+	slot = shard_find(kv, sh, hash, key, key_size);
+	if (slot != NULL) {
+		struct pm_record *rec = rec_at(kv, *slot);
+
+		if (rec->codec == PMKV_CODEC_NONE) {
+			memcpy(out_val, rec->data, rec->val_size);
+			*out_val_size = rec->val_size;
+		} else {
+			long n = codec_decompress(rec->codec, rec->data, rec->val_size,
+					out_val, MAX_VAL_LEN);
+
+			if (n < 0) {
+				pthread_rwlock_unlock(&sh->lock);
+				return 1;
+			}
+			*out_val_size = n;
+		}
+		/* filled under the shard lock so no put can slip in between */
+		if (kv->cache != NULL)
+			cache_put(kv->cache, hash, key, key_size, out_val, *out_val_size);
+	}
+	pthread_rwlock_unlock(&sh->lock);
+	return slot != NULL ? 0 : 1;
+}
+
+static int kv_put(struct kv *kv, uint64_t hash, const char *key, size_t key_size,
+		const char *val, size_t val_size)
+{
+	struct shard *sh = shard_of(kv, hash);
+	uint64_t *slot;
+	uint64_t *free_slot = NULL;
+	const char *data = val;
+	size_t data_size = val_size;
+	int codec = PMKV_CODEC_NONE;
+	uint64_t off;
+	int ret = 1;
+
+	numa_account(kv, sh);
+
+	if (val_size > MAX_VAL_LEN || (kv->fixed_key && key_size != PMKV_FIXED_KEY_SIZE))
+		return 1;
+
+	/* compressed before taking the lock */
+	if (kv->codec != PMKV_CODEC_NONE && val_size >= kv->compress_min && val_size > 0) {
+		char *buf = codec_scratch(val_size);
+		size_t n = 0;
+
+		if (buf != NULL)
+			n = codec_compress(kv->codec, val, val_size, buf,
+					val_size - val_size / COMPRESS_MIN_GAIN);
+		if (n > 0) {
+			data = buf;
+			data_size = n;
+			codec = kv->codec;
+		}
+	}
+
+	pthread_rwlock_wrlock(&sh->lock);
+	slot = shard_find(kv, sh, hash, key, key_size);
+	if (slot != NULL) {
+		struct pm_record *rec = rec_at(kv, *slot);
+
+		if (rec->codec == codec && rec->val_size == data_size &&
+		    update_in_place(kv, sh, *slot, data, data_size) == 0) {
+			ret = 0;
+			goto out;
+		}
+	} else if (sh->next == NULL && shard_full(sh) &&
+		   shard_resize_start(kv, sh, (sh->mask + 1) * 2)) {
+		goto out;
+	} else {
+		/* claimed first so persisting the record also drains an inline key */
+		free_slot = shard_free_slot(kv, sh, hash, key);
+	}
+
+	off = log_append(kv, sh, hash, key, key_size, data, data_size, codec);
+	if (off == 0)
+		goto out;
+
+	if (slot != NULL) {
+		uint64_t old = *slot;
+
+		__atomic_store_n(slot, off, __ATOMIC_RELEASE);
+		persist(kv, slot, sizeof(*slot));
+		record_dead(kv, sh, old);
+	} else {
+		slot = free_slot;
+		__atomic_store_n(slot, off, __ATOMIC_RELEASE);
+		persist(kv, slot, sizeof(*slot));
+		__atomic_store_n(&sh->count, sh->count + 1, __ATOMIC_RELAXED);
+		shard_filter_add(sh, hash, 1);
+	}
+	ret = 0;
+out:
+	if (ret == 0 && codec != PMKV_CODEC_NONE) {
+		__atomic_store_n(&sh->compressed, sh->compressed + 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&sh->compress_saved, sh->compress_saved + val_size - data_size,
+				__ATOMIC_RELAXED);
+	}
+	if (ret == 0 && kv->cache != NULL)
+		cache_put(kv->cache, hash, key, key_size, val, val_size);
+	if (sh->next != NULL)
+		shard_migrate(kv, sh, RESIZE_STEP);
+	pthread_rwlock_unlock(&sh->lock);
+	return ret;
+}
+
+static int kv_delete(struct kv *kv, uint64_t hash, const char *key, size_t key_size)
+{
+	struct shard *sh = shard_of(kv, hash);
+	uint64_t *slot;
+	uint64_t old;
+
+	numa_account(kv, sh);
+
+	pthread_rwlock_wrlock(&sh->lock);
+	slot = shard_find(kv, sh, hash, key, key_size);
+	if (slot == NULL) {
+		pthread_rwlock_unlock(&sh->lock);
+		return 1;
+	}
+	old = *slot;
+	__atomic_store_n(slot, 0, __ATOMIC_RELEASE);
+	persist(kv, slot, sizeof(*slot));
+	__atomic_store_n(&sh->count, sh->count - 1, __ATOMIC_RELAXED);
+	shard_filter_add(sh, hash, -1);
+	record_dead(kv, sh, old);
+	if (kv->cache != NULL)
+		cache_remove(kv->cache, hash, key, key_size);
+	if (sh->next == NULL && shard_sparse(sh))
+		shard_resize_start(kv, sh, (sh->mask + 1) / 2);
+	if (sh->next != NULL)
+		shard_migrate(kv, sh, RESIZE_STEP);
+	pthread_rwlock_unlock(&sh->lock);
+	return 0;
+}
+
+static int kv_exists(struct kv *kv, uint64_t hash, const char *key, size_t key_size)
+{
+	struct shard *sh = shard_of(kv, hash);
+	uint64_t *slot;
+
+	numa_account(kv, sh);
+
+	pthread_rwlock_rdlock(&sh->lock);
+	if (kv->cache != NULL && cache_get(kv->cache, hash, key, key_size, NULL, NULL) == 0) {
+		pthread_rwlock_unlock(&sh->lock);
+		return 1;
+	}
+	slot = shard_find(kv, sh, hash, key, key_size);
+	pthread_rwlock_unlock(&sh->lock);
+	return slot != NULL;
+}
+
+/*
+ * Whether sealing the shard's active log chunk for pmkv_compact() frees a
+ * chunk.  Its live records then move along with those of the sealed chunks
+ * the pass evacuates, so they must all fit in fewer chunks than the kept
+ * active chunk plus what overflows its free tail.  Moving the few records of
+ * a fresh chunk into another fresh chunk gains nothing.  The caller holds the
+ * shard lock.
+ */
+static int compact_seal_pays(struct kv *kv, struct shard *sh)
+{
+	uint32_t n = __atomic_load_n(&kv->nchunk_desc, __ATOMIC_ACQUIRE);
+	uint32_t shard = sh - kv->shard;
+	struct chunk_desc *log = sh->log;
+	uint64_t room = CHUNK_SIZE - sizeof(struct pm_chunk);
+	uint64_t tail = log->size - sh->log_tail;
+	uint64_t moved = 0, keep, seal;
+	uint32_t idx;
+
+	for (idx = 0; idx < n; idx++) {
+		struct chunk_desc *c = chunk_desc_at(kv, idx);
+
+		if (__atomic_load_n(&c->off, __ATOMIC_RELAXED) == 0 || c == log ||
+		    c->shard != shard || c->live * 100 > c->size * COMPACT_MANUAL_PCT)
+			continue;
+		moved += c->live;
+	}
+	keep = 1 + (moved > tail ? (moved - tail + room - 1) / room : 0);
+	seal = (moved + log->live + room - 1) / room;
+	return seal < keep;
+}
+
+static void kv_compact(struct kv *kv)
+{
+	int s;
+
+	for (s = 0; s < NSHARDS; s++) {
+		struct shard *sh = &kv->shard[s];
+		struct chunk_desc *c;
+		int resized = 0;
+
+		/* finish any running resize, then fit the index to what is left */
+		for (;;) {
+			shard_migrate_all(kv, sh);
+			if (resized)
+				break;
+			pthread_rwlock_wrlock(&sh->lock);
+			if (sh->next == NULL && fit_buckets(sh->count) < sh->mask + 1)
+				resized = !shard_resize_start(kv, sh, fit_buckets(sh->count));
+			pthread_rwlock_unlock(&sh->lock);
+			if (!resized)
+				break;
+		}
+
+		/* an empty active log chunk goes, a sparse one is merged if that pays */
+		pthread_rwlock_wrlock(&sh->lock);
+		c = sh->log;
+		if (c != NULL && (c->live == 0 ||
+		    (c->live * 100 <= c->size * COMPACT_MANUAL_PCT && compact_seal_pays(kv, sh)))) {
+			sh->log = NULL;
+			if (c->live == 0)
+				chunk_free(kv, c);
+		}
+		pthread_rwlock_unlock(&sh->lock);
+	}
+	compact_pass(kv, COMPACT_MANUAL_PCT, 0);
+}
+
+/* Add this pool's figures to 'out'. */
+static inline int size_class(size_t size)
+{
+	int i = size <= 4096 ? 0 : 64 - __builtin_clzll(size - 1) - 12;
+
+	return i < PMKV_SIZE_CLASSES ? i : PMKV_SIZE_CLASSES - 1;
+}
+
+static void stats_alloc(struct pmkv_stats *out, size_t size)
+{
+	out->allocated_bytes += size;
+	out->alloc_bytes[size_class(size)] += size;
+}
+
+static void kv_stats(struct kv *kv, struct pmkv_stats *out)
+{
+	uint32_t n = __atomic_load_n(&kv->nchunk_desc, __ATOMIC_ACQUIRE);
+	size_t allocated = out->allocated_bytes;
+	uint32_t idx;
+	int s;
+
+	stats_alloc(out, sizeof(struct pm_root));
+	for (idx = 0; idx < n; idx++) {
+		struct chunk_desc *c = chunk_desc_at(kv, idx);
+
+		if (__atomic_load_n(&c->off, __ATOMIC_RELAXED) == 0)
+			continue;
+		out->log_chunks++;
+		out->log_bytes += c->size;
+		out->live_bytes += __atomic_load_n(&c->live, __ATOMIC_RELAXED);
+		stats_alloc(out, c->size);
+	}
+	out->dram_index_bytes += sizeof(*kv) +
+			(n + CHUNK_PAGE_SIZE - 1) / CHUNK_PAGE_SIZE * CHUNK_PAGE_SIZE *
+			sizeof(struct chunk_desc);
+	out->compacted_chunks += __atomic_load_n(&kv->compact_chunks, __ATOMIC_RELAXED);
+	out->compacted_bytes += __atomic_load_n(&kv->compact_moved, __ATOMIC_RELAXED);
+	out->reclaimed_chunks += __atomic_load_n(&kv->chunks_reclaimed, __ATOMIC_RELAXED);
+
+	for (s = 0; s < NSHARDS; s++) {
+		struct shard *sh = &kv->shard[s];
+
+		size_t table, next = 0;
+		size_t filters;
+
+		pthread_rwlock_rdlock(&sh->lock);
+		table = table_size(kv, sh->mask + 1);
+		if (sh->next != NULL)
+			next = table_size(kv, sh->next_mask + 1);
+		filters = filter_bytes(&sh->filter) + filter_bytes(&sh->next_filter);
+		out->live_keys += sh->count;
+		pthread_rwlock_unlock(&sh->lock);
+		out->index_bytes += table + next;
+		stats_alloc(out, table);
+		if (next > 0)
+			stats_alloc(out, next);
+		out->filter_bytes += filters;
+		out->dram_index_bytes += filters;
+		out->filter_negatives += __atomic_load_n(&sh->filter_neg, __ATOMIC_RELAXED);
+		out->filter_false_positives += __atomic_load_n(&sh->filter_fp, __ATOMIC_RELAXED);
+		out->numa_local += __atomic_load_n(&sh->numa_local, __ATOMIC_RELAXED);
+		out->numa_remote += __atomic_load_n(&sh->numa_remote, __ATOMIC_RELAXED);
+		out->compressed_puts += __atomic_load_n(&sh->compressed, __ATOMIC_RELAXED);
+		out->compressed_saved += __atomic_load_n(&sh->compress_saved, __ATOMIC_RELAXED);
+	}
+	if (kv->cache != NULL) {
+		size_t bytes, hits, misses;
+
+		cache_stats(kv->cache, &bytes, &hits, &misses);
+		out->cache_bytes += bytes;
+		out->cache_hits += hits;
+		out->cache_misses += misses;
+	}
+	out->hash = kv->root->hash;
+	out->key_size = kv->root->key_size;
+	out->pool_bytes += kv->pool_bytes;
+	allocated = out->allocated_bytes - allocated;
+	if (kv->pool_bytes > allocated)
+		out->free_bytes += kv->pool_bytes - allocated;
+}
+
+/* public interface: route each call to the pool of the key's node */
 
 pmkv* pmkv_open(const char *path, size_t pool_size, int force_create)
 {
-	// TODO: implement this
+	return pmkv_open_opts(path, pool_size, force_create, NULL);
+}
+
+pmkv* pmkv_open_opts(const char *path, size_t pool_size, int force_create,
+		const struct pmkv_options *opts)
+{
+	const char *const *paths = &path;
+	struct db *db;
+	int n = 1;
+	int i;
+
+	if (opts != NULL && opts->nodes != 0) {
+		if (opts->nodes < 0 || opts->nodes > PMKV_MAX_NODES)
+			return NULL;
+		paths = opts->node_paths;
+		n = opts->nodes;
+	}
+	db = calloc(1, sizeof(*db));
+	if (db == NULL)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		if (paths[i] == NULL)
+			goto err;
+		db->node[i] = kv_open(paths[i], pool_size, force_create, opts, i, n);
+		if (db->node[i] == NULL)
+			goto err;
+		db->nodes++;
+		/* keys are routed by hash, so every pool must hash alike */
+		if (db->node[i]->hash != db->node[0]->hash)
+			goto err;
+	}
+	return (pmkv*)db;
+
+err:
+	for (i = 0; i < db->nodes; i++)
+		kv_close(db->node[i]);
+	free(db);
 	return NULL;
 }
 
 void pmkv_close(pmkv *kv)
 {
-	// TODO: implement this
+	struct db *db = (struct db*)kv;
+	int i;
+
+	if (db == NULL)
+		return;
+	for (i = 0; i < db->nodes; i++)
+		kv_close(db->node[i]);
+	free(db);
+}
+
+uint64_t pmkv_hash_key(pmkv *kv, const char *key, size_t key_size)
+{
+	struct db *db = (struct db*)kv;
+
+	return db->node[0]->hash(key, key_size);
+}
+
+int pmkv_get_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size,
+		char *out_val, size_t *out_val_size)
+{
+	struct db *db = (struct db*)kv;
+
+	return kv_get(db->node[node_of(db, hash)], hash, key, key_size, out_val, out_val_size);
 }
 
 int pmkv_get(pmkv *kv, const char *key, size_t key_size, char *out_val, size_t *out_val_size)
 {
-	// TODO: implement this
-	return 1;
+	return pmkv_get_hashed(kv, pmkv_hash_key(kv, key, key_size), key, key_size, out_val, out_val_size);
+}
+
+int pmkv_put_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size,
+		const char *val, size_t val_size)
+{
+	struct db *db = (struct db*)kv;
+
+	return kv_put(db->node[node_of(db, hash)], hash, key, key_size, val, val_size);
 }
 
 int pmkv_put(pmkv *kv, const char *key, size_t key_size, const char *val, size_t val_size)
 {
-	// TODO: implement this
-	return 1;
+	return pmkv_put_hashed(kv, pmkv_hash_key(kv, key, key_size), key, key_size, val, val_size);
+}
+
+int pmkv_delete_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size)
+{
+	struct db *db = (struct db*)kv;
+
+	return kv_delete(db->node[node_of(db, hash)], hash, key, key_size);
 }
 
 int pmkv_delete(pmkv *kv, const char *key, size_t key_size)
 {
-	// TODO: implement this
-	return 1;
+	return pmkv_delete_hashed(kv, pmkv_hash_key(kv, key, key_size), key, key_size);
 }
 
 int pmkv_count_all(pmkv *kv, size_t *out_cnt)
 {
-	// TODO: implement this
-	return 1;
+	struct db *db = (struct db*)kv;
+	size_t cnt = 0;
+	int i, s;
+
+	for (i = 0; i < db->nodes; i++) {
+		for (s = 0; s < NSHARDS; s++)
+			cnt += __atomic_load_n(&db->node[i]->shard[s].count, __ATOMIC_RELAXED);
+	}
+	*out_cnt = cnt;
+	return 0;
+}
+
+int pmkv_exists_hashed(pmkv *kv, uint64_t hash, const char *key, size_t key_size)
+{
+	struct db *db = (struct db*)kv;
+
+	return kv_exists(db->node[node_of(db, hash)], hash, key, key_size);
 }
 
 int pmkv_exists(pmkv *kv, const char *key, size_t key_size)
 {
-	// TODO: implement this
+	return pmkv_exists_hashed(kv, pmkv_hash_key(kv, key, key_size), key, key_size);
+}
+
+int pmkv_compact(pmkv *kv)
+{
+	struct db *db = (struct db*)kv;
+	int i;
+
+	for (i = 0; i < db->nodes; i++)
+		kv_compact(db->node[i]);
+	return 0;
+}
+
+int pmkv_get_stats(pmkv *kv, struct pmkv_stats *out)
+{
+	struct db *db = (struct db*)kv;
+	int i;
+
+	memset(out, 0, sizeof(*out));
+	for (i = 0; i < db->nodes; i++)
+		kv_stats(db->node[i], out);
+	out->nodes = db->nodes;
+	if (out->allocated_bytes > 0)
+		out->fragmentation = (double)(out->log_bytes - out->live_bytes) / out->allocated_bytes;
+	return 0;
+}
+
+int pmkv_nodes(pmkv *kv)
+{
+	struct db *db = (struct db*)kv;
+
+	return db->nodes;
+}
+
+int pmkv_key_node(pmkv *kv, uint64_t hash)
+{
+	struct db *db = (struct db*)kv;
+
+	return node_of(db, hash);
+}
+
+int pmkv_bind_thread(pmkv *kv, int node)
+{
+	struct db *db = (struct db*)kv;
+
+	if (node < 0 || node >= db->nodes || bind_node(node))
+		return 1;
+	thread_node = node;
 	return 0;
 }
@@ -1,9 +1,18 @@
 #include "gtest/gtest.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
 #include <thread>
 #include <vector>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "libpmemkv.hpp"
 extern "C" {
 #include "pmkv.h"
+#include "../src/codec.h"
 }
 
 const size_t SIZE = 1024ull * 1024ull * 512ull;
@@ -26,12 +35,27 @@ void parallel_exec(size_t threads_number, Function f)
 	}
 }
 
+// Remove a pool file, or a poolset directory part and the part files in it
+static void remove_pool(const std::string &path)
+{
+	DIR *d = opendir(path.c_str());
+	if (d != NULL) {
+		struct dirent *e;
+		while ((e = readdir(d)) != NULL) {
+			if (e->d_name[0] != '.')
+				std::remove((path + "/" + e->d_name).c_str());
+		}
+		closedir(d);
+	}
+	std::remove(path.c_str());
+}
+
 // wrapper class to use most of pmemkv testcases
 class PMKVWrapper {
 public:
-	PMKVWrapper(std::string path, size_t size, bool create)
+	PMKVWrapper(std::string path, size_t size, bool create, struct pmkv_options opts = {})
 	{
-		_kv = pmkv_open(path.c_str(), size, create ? 1 : 0);
+		_kv = pmkv_open_opts(path.c_str(), size, create ? 1 : 0, &opts);
 	}
 
 	~PMKVWrapper()
@@ -74,6 +98,58 @@ public:
 		return status::OK;
 	}
 
+	status stats(struct pmkv_stats *st) {
+		return (status)pmkv_get_stats(_kv, st);
+	}
+
+	status compact() {
+		return (status)pmkv_compact(_kv);
+	}
+
+	uint64_t hash(string_view key) {
+		return pmkv_hash_key(_kv, key.data(), key.size());
+	}
+
+	status get_hashed(uint64_t hash, string_view key, std::string *value) {
+		char val[MAX_VAL_LEN];
+		size_t val_size;
+		if (pmkv_get_hashed(_kv, hash, key.data(), key.size(), val, &val_size))
+			return status::NOT_FOUND;
+		value->assign(val, val_size);
+		return status::OK;
+	}
+
+	status put_hashed(uint64_t hash, string_view key, string_view value) {
+		return (status)pmkv_put_hashed(_kv, hash, key.data(), key.size(),
+				value.data(), value.size());
+	}
+
+	status remove_hashed(uint64_t hash, string_view key) {
+		if (pmkv_delete_hashed(_kv, hash, key.data(), key.size()))
+			return status::NOT_FOUND;
+		return status::OK;
+	}
+
+	status exists_hashed(uint64_t hash, string_view key) {
+		if (!pmkv_exists_hashed(_kv, hash, key.data(), key.size()))
+			return status::NOT_FOUND;
+		return status::OK;
+	}
+
+	int nodes() {
+		return pmkv_nodes(_kv);
+	}
+
+	int key_node(uint64_t hash) {
+		return pmkv_key_node(_kv, hash);
+	}
+
+	status bind_thread(int node) {
+		if (pmkv_bind_thread(_kv, node))
+			return status::NOT_SUPPORTED;
+		return status::OK;
+	}
+
 private:
 	pmkv* _kv;
 };
@@ -83,6 +159,7 @@ class PMKVBaseTest : public ::testing::Test {
 public:
 	std::string PATH = "/mnt/ramdisk/test";
 	PMKVWrapper *kv;
+	std::vector<std::string> files;	// other pool files of a test, removed at teardown
 	PMKVBaseTest()
 	{
 		std::remove(PATH.c_str());
@@ -92,18 +169,20 @@ public:
 	~PMKVBaseTest()
 	{
 		delete kv;
+		for (auto &f : files)
+			remove_pool(f);
 	}
 
-	void Restart()
+	void Restart(struct pmkv_options opts = {})
 	{
 		delete kv;
-		Start(false);
+		Start(false, opts);
 	}
 
 protected:
-	void Start(bool create)
+	void Start(bool create, struct pmkv_options opts = {})
 	{
-		kv = new PMKVWrapper(PATH, POOL_SIZE, create);
+		kv = new PMKVWrapper(PATH, POOL_SIZE, create, opts);
 	}
 };
 
@@ -554,6 +633,888 @@ TEST_F(PMKVTest, SimpleMultithreadedTest)
 	ASSERT_TRUE(cnt == threads_number * thread_items);
 }
 
+TEST_F(PMKVTest, InPlaceUpdateTest)
+{
+	ASSERT_TRUE(kv->is_db_valid());
+	// up to 8 bytes take an atomic store, up to 4 KiB the shard undo slot
+	const size_t sizes[] = {1, 8, 9, 1000, 4096};
+	auto value = [](size_t size, int gen) {
+		std::string v(size, 'a' + gen % 26);
+		v[0] = '0' + gen % 10;
+		return v;
+	};
+	for (size_t size : sizes) {
+		std::string key = std::to_string(size);
+		ASSERT_TRUE(kv->put(key, value(size, 0)) == status::OK) << errormsg();
+	}
+	struct pmkv_stats before, after;
+	ASSERT_TRUE(kv->stats(&before) == status::OK);
+	// several chunks of log if any of these were appended instead
+	const int gens = 1000;
+	for (int gen = 1; gen <= gens; gen++) {
+		for (size_t size : sizes) {
+			std::string key = std::to_string(size);
+			ASSERT_TRUE(kv->put(key, value(size, gen)) == status::OK) << errormsg();
+		}
+	}
+	ASSERT_TRUE(kv->stats(&after) == status::OK);
+	ASSERT_TRUE(after.log_bytes == before.log_bytes);
+	ASSERT_TRUE(after.allocated_bytes == before.allocated_bytes);
+	ASSERT_TRUE(after.live_bytes == before.live_bytes);
+	// appended chunks the compactor already gave back would show here
+	ASSERT_TRUE(after.compacted_chunks == before.compacted_chunks);
+	ASSERT_TRUE(after.reclaimed_chunks == before.reclaimed_chunks);
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t size : sizes) {
+			std::string key = std::to_string(size);
+			std::string v;
+			ASSERT_TRUE(kv->get(key, &v) == status::OK);
+			ASSERT_TRUE(v == value(size, gens));
+		}
+		Restart();
+	}
+}
+
+#ifdef PMKV_TESTING
+TEST_F(PMKVTest, InPlaceRecoveryTest)
+{
+	ASSERT_TRUE(kv->is_db_valid());
+	ASSERT_TRUE(kv->put("word", std::string(8, 'a')) == status::OK) << errormsg();
+	ASSERT_TRUE(kv->put("undo", std::string(9, 'a')) == status::OK) << errormsg();
+	delete kv;
+	kv = NULL;
+	// only the undo slot path reaches the crash point; the child dies there
+	// with the new value written and the slot still armed
+	pid_t pid = fork();
+	if (pid == 0) {
+		PMKVWrapper child(PATH, SIZE, false);
+		pmkv_crash_at(PMKV_CRASH_UNDO, 1);
+		child.put("word", std::string(8, 'b'));
+		child.put("undo", std::string(9, 'b'));
+		_exit(0);
+	}
+	int wstatus;
+	ASSERT_TRUE(waitpid(pid, &wstatus, 0) == pid);
+	ASSERT_TRUE(WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == SIGKILL);
+	Start(false);
+	ASSERT_TRUE(kv->is_db_valid());
+	std::string value;
+	ASSERT_TRUE(kv->get("word", &value) == status::OK && value == std::string(8, 'b'));
+	ASSERT_TRUE(kv->get("undo", &value) == status::OK && value == std::string(9, 'a'));
+	Restart();
+	ASSERT_TRUE(kv->get("undo", &value) == status::OK && value == std::string(9, 'a'));
+}
+#endif
+
+TEST_F(PMKVTest, CompactionTest)
+{
+	ASSERT_TRUE(kv->is_db_valid());
+	const int items = 50000;
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, std::string(200, 'a')) == status::OK) << errormsg();
+	}
+	// overwrite three keys out of four with a different size so the first
+	// generation of records is left mostly dead
+	for (int i = 0; i < items; i++) {
+		if (i % 4 == 0)
+			continue;
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, std::string(208, 'b')) == status::OK) << errormsg();
+	}
+	struct pmkv_stats st;
+	for (int i = 0; i < 100; i++) {
+		ASSERT_TRUE(kv->stats(&st) == status::OK);
+		if (st.compacted_chunks > 0)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+	ASSERT_TRUE(st.compacted_chunks > 0);
+	ASSERT_TRUE(st.compacted_bytes > 0);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < items; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			ASSERT_TRUE(kv->get(istr, &value) == status::OK);
+			ASSERT_TRUE(value == (i % 4 == 0 ? std::string(200, 'a') : std::string(208, 'b')));
+		}
+		std::size_t cnt = std::numeric_limits<std::size_t>::max();
+		ASSERT_TRUE(kv->count_all(cnt) == status::OK);
+		ASSERT_TRUE(cnt == items);
+		Restart();
+	}
+}
+
+TEST_F(PMKVTest, ShrinkTest)
+{
+	ASSERT_TRUE(kv->is_db_valid());
+	// a few records in fresh log chunks: moving them would free nothing
+	for (int i = 0; i < 100; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, std::string(200, 'a')) == status::OK) << errormsg();
+	}
+	struct pmkv_stats fresh, compacted;
+	ASSERT_TRUE(kv->stats(&fresh) == status::OK);
+	ASSERT_TRUE(kv->compact() == status::OK);
+	ASSERT_TRUE(kv->stats(&compacted) == status::OK);
+	ASSERT_TRUE(compacted.compacted_bytes == fresh.compacted_bytes);
+	ASSERT_TRUE(compacted.log_chunks == fresh.log_chunks);
+
+	const int items = 200000;
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, std::string(200, 'a')) == status::OK) << errormsg();
+	}
+	struct pmkv_stats full;
+	ASSERT_TRUE(kv->stats(&full) == status::OK);
+	// keep one key in ten
+	for (int i = 0; i < items; i++) {
+		if (i % 10 == 0)
+			continue;
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->remove(istr) == status::OK);
+	}
+	ASSERT_TRUE(kv->compact() == status::OK);
+	struct pmkv_stats st;
+	ASSERT_TRUE(kv->stats(&st) == status::OK);
+	ASSERT_TRUE(st.log_bytes * 2 < full.log_bytes);
+	ASSERT_TRUE(st.reclaimed_chunks > full.reclaimed_chunks);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < items; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			if (i % 10 == 0) {
+				ASSERT_TRUE(kv->get(istr, &value) == status::OK);
+				ASSERT_TRUE(value == std::string(200, 'a'));
+			} else {
+				ASSERT_TRUE(kv->get(istr, &value) == status::NOT_FOUND);
+			}
+		}
+		std::size_t cnt = std::numeric_limits<std::size_t>::max();
+		ASSERT_TRUE(kv->count_all(cnt) == status::OK);
+		ASSERT_TRUE(cnt == items / 10);
+		Restart();
+	}
+	// the shrunk index still grows back
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, std::string(200, 'c')) == status::OK) << errormsg();
+	}
+	std::size_t cnt = std::numeric_limits<std::size_t>::max();
+	ASSERT_TRUE(kv->count_all(cnt) == status::OK);
+	ASSERT_TRUE(cnt == items);
+}
+
+#ifdef PMKV_TESTING
+TEST_F(PMKVTest, ResizeResumeTest)
+{
+	ASSERT_TRUE(kv->is_db_valid());
+	// enough keys to grow every shard index once; a child writes them and
+	// dies midway through a resize, with one entry left in both tables
+	const int items = 6000;
+	int *done = (int *)mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	ASSERT_TRUE(done != MAP_FAILED);
+	*done = 0;
+	delete kv;
+	kv = NULL;
+	pid_t pid = fork();
+	if (pid == 0) {
+		PMKVWrapper child(PATH, SIZE, false);
+		pmkv_crash_at(PMKV_CRASH_MIGRATE, 1000);
+		for (int i = 0; i < items; i++) {
+			std::string istr = std::to_string(i);
+			if (child.put(istr, istr) != status::OK)
+				break;
+			*done = i + 1;
+		}
+		_exit(0);
+	}
+	int wstatus;
+	ASSERT_TRUE(waitpid(pid, &wstatus, 0) == pid);
+	ASSERT_TRUE(WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == SIGKILL);
+	const int written = *done;
+	munmap(done, sizeof(int));
+	ASSERT_TRUE(written > 0 && written < items);
+	Start(false);
+	ASSERT_TRUE(kv->is_db_valid());
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < written; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			ASSERT_TRUE(kv->get(istr, &value) == status::OK);
+			ASSERT_TRUE(value == istr);
+		}
+		// the put that died may or may not have published its key
+		std::size_t cnt = std::numeric_limits<std::size_t>::max();
+		ASSERT_TRUE(kv->count_all(cnt) == status::OK);
+		ASSERT_TRUE(cnt == written || cnt == written + 1);
+		Restart();
+	}
+	// a copy left behind in either table would outlive the delete
+	for (int i = 0; i <= written; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->remove(istr) == status::OK || i == written);
+	}
+	Restart();
+	for (int i = 0; i <= written; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->exists(istr) == status::NOT_FOUND);
+	}
+	std::size_t cnt = std::numeric_limits<std::size_t>::max();
+	ASSERT_TRUE(kv->count_all(cnt) == status::OK);
+	ASSERT_TRUE(cnt == 0);
+}
+#endif
+
+TEST_F(PMKVTest, FingerprintTest)
+{
+	ASSERT_TRUE(kv->is_db_valid());
+	// keys whose home is bucket 0 of shard 0 in a new pool's 64-bucket
+	// index, more than the bucket holds, so some go to the next bucket
+	std::vector<std::string> shared;
+	for (int i = 0; shared.size() < 12; i++) {
+		std::string key = "shared" + std::to_string(i);
+		uint64_t hash = kv->hash(key);
+		if ((hash >> 60) == 0 && (hash & 63) == 0)
+			shared.push_back(key);
+	}
+	for (auto &key : shared)
+		ASSERT_TRUE(kv->put(key, key) == status::OK) << errormsg();
+	const int items = 30000;
+	auto check = [&](int n) {
+		for (auto &key : shared) {
+			std::string value;
+			ASSERT_TRUE(kv->get(key, &value) == status::OK);
+			ASSERT_TRUE(value == key);
+		}
+		for (int i = 0; i < n; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			ASSERT_TRUE(kv->get(istr, &value) == status::OK);
+			ASSERT_TRUE(value == istr);
+			ASSERT_TRUE(kv->exists("missing" + istr) == status::NOT_FOUND);
+		}
+	};
+	// fingerprints are rebuilt at open
+	Restart();
+	check(0);
+
+	// grow every shard index, moving the shared bucket into a larger table
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, istr) == status::OK) << errormsg();
+	}
+	check(items);
+	ASSERT_TRUE(kv->compact() == status::OK);
+	check(items);
+	Restart();
+	check(items);
+}
+
+TEST_F(PMKVTest, FilterTest)
+{
+	ASSERT_TRUE(kv->is_db_valid());
+	const int items = 20000;
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, istr) == status::OK) << errormsg();
+	}
+	// drop the odd keys so the filter has seen deletes too
+	for (int i = 1; i < items; i += 2) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->remove(istr) == status::OK);
+	}
+	for (int pass = 0; pass < 2; pass++) {
+		struct pmkv_stats before, after;
+		ASSERT_TRUE(kv->stats(&before) == status::OK);
+		ASSERT_TRUE(before.filter_bytes > 0);
+		for (int i = 0; i < items; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			if (i % 2 == 0) {
+				ASSERT_TRUE(kv->get(istr, &value) == status::OK);
+				ASSERT_TRUE(value == istr);
+			} else {
+				ASSERT_TRUE(kv->get(istr, &value) == status::NOT_FOUND);
+			}
+			ASSERT_TRUE(kv->exists("missing" + istr) == status::NOT_FOUND);
+		}
+		ASSERT_TRUE(kv->stats(&after) == status::OK);
+		size_t neg = after.filter_negatives - before.filter_negatives;
+		size_t fp = after.filter_false_positives - before.filter_false_positives;
+		ASSERT_TRUE(neg + fp == items / 2 + items);
+		ASSERT_TRUE(fp * 20 < neg + fp);
+		Restart();
+	}
+}
+
+TEST_F(PMKVTest, CacheTest)
+{
+	const size_t cache_bytes = 1024 * 1024;
+	struct pmkv_options opts = {};
+	opts.cache_bytes = cache_bytes;
+	Restart(opts);
+	ASSERT_TRUE(kv->is_db_valid());
+	const int items = 20000;
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, std::string(100, 'a')) == status::OK) << errormsg();
+	}
+	// a hot set that fits is served from DRAM after the first pass
+	for (int pass = 0; pass < 3; pass++) {
+		for (int i = 0; i < 100; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			ASSERT_TRUE(kv->get(istr, &value) == status::OK);
+			ASSERT_TRUE(value == std::string(100, 'a'));
+		}
+	}
+	struct pmkv_stats st;
+	ASSERT_TRUE(kv->stats(&st) == status::OK);
+	ASSERT_TRUE(st.cache_hits >= 200);
+	ASSERT_TRUE(st.cache_bytes > 0 && st.cache_bytes <= cache_bytes);
+
+	// puts write through and deletes invalidate
+	for (int i = 0; i < 100; i++) {
+		std::string istr = std::to_string(i);
+		std::string value;
+		if (i % 3 == 0) {
+			ASSERT_TRUE(kv->put(istr, std::string(100, 'b')) == status::OK);
+		} else if (i % 3 == 1) {
+			ASSERT_TRUE(kv->put(istr, "c") == status::OK);
+		} else {
+			ASSERT_TRUE(kv->remove(istr) == status::OK);
+		}
+	}
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < 100; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			if (i % 3 == 2) {
+				ASSERT_TRUE(kv->get(istr, &value) == status::NOT_FOUND);
+				ASSERT_TRUE(kv->exists(istr) == status::NOT_FOUND);
+				continue;
+			}
+			ASSERT_TRUE(kv->get(istr, &value) == status::OK);
+			ASSERT_TRUE(value == (i % 3 == 0 ? std::string(100, 'b') : "c"));
+		}
+		Restart(opts);
+	}
+}
+
+TEST_F(PMKVTest, HashedTest)
+{
+	ASSERT_TRUE(kv->is_db_valid());
+	const int items = 10000;
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		uint64_t h = kv->hash(istr);
+		ASSERT_TRUE(h == kv->hash(istr));
+		ASSERT_TRUE(kv->exists_hashed(h, istr) == status::NOT_FOUND);
+		ASSERT_TRUE(kv->put_hashed(h, istr, istr) == status::OK) << errormsg();
+		ASSERT_TRUE(kv->exists_hashed(h, istr) == status::OK);
+	}
+	for (int i = 0; i < items; i += 2) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->remove_hashed(kv->hash(istr), istr) == status::OK);
+	}
+	// the hashed and plain calls see the same data
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < items; i++) {
+			std::string istr = std::to_string(i);
+			std::string value, hvalue;
+			status s = kv->get(istr, &value);
+			ASSERT_TRUE(kv->get_hashed(kv->hash(istr), istr, &hvalue) == s);
+			if (i % 2 == 0) {
+				ASSERT_TRUE(s == status::NOT_FOUND);
+			} else {
+				ASSERT_TRUE(s == status::OK && value == istr && hvalue == istr);
+			}
+		}
+		Restart();
+	}
+}
+
+TEST_F(PMKVTest, HashKernelTest)
+{
+	const int kernels[] = { PMKV_HASH_PORTABLE, PMKV_HASH_CRC32C, PMKV_HASH_AES };
+	for (int kernel : kernels) {
+		struct pmkv_options opts = {};
+		opts.hash = kernel;
+		delete kv;
+		std::remove(PATH.c_str());
+		Start(true, opts);
+		if (!kv->is_db_valid())
+			continue;	// not supported by this CPU
+		for (int i = 0; i < 10000; i++) {
+			std::string istr = std::to_string(i);
+			ASSERT_TRUE(kv->put(istr, istr) == status::OK) << errormsg();
+		}
+		// the kernel recorded at create wins over what reopen asks for
+		for (int other : kernels) {
+			opts.hash = other;
+			Restart(opts);
+			ASSERT_TRUE(kv->is_db_valid());
+			struct pmkv_stats st;
+			ASSERT_TRUE(kv->stats(&st) == status::OK);
+			ASSERT_TRUE(st.hash == (size_t)kernel);
+			for (int i = 0; i < 10000; i++) {
+				std::string istr = std::to_string(i);
+				std::string value;
+				ASSERT_TRUE(kv->get(istr, &value) == status::OK && value == istr);
+			}
+		}
+	}
+	// a kernel no CPU has fails a create, leaving no pool behind, but a
+	// reopen uses the pool's own kernel and ignores it
+	struct pmkv_options opts = {};
+	opts.hash = PMKV_HASH_AES + 1;
+	delete kv;
+	std::remove(PATH.c_str());
+	Start(true, opts);
+	ASSERT_FALSE(kv->is_db_valid());
+	delete kv;
+	Start(true);
+	ASSERT_TRUE(kv->is_db_valid());
+	ASSERT_TRUE(kv->put("key1", "value1") == status::OK) << errormsg();
+	Restart(opts);
+	ASSERT_TRUE(kv->is_db_valid());
+	std::string value;
+	ASSERT_TRUE(kv->get("key1", &value) == status::OK && value == "value1");
+}
+
+TEST_F(PMKVTest, FixedKeyTest)
+{
+	struct pmkv_options opts = {};
+	opts.key_size = PMKV_FIXED_KEY_SIZE;
+	delete kv;
+	std::remove(PATH.c_str());
+	Start(true, opts);
+	ASSERT_TRUE(kv->is_db_valid());
+	// keys of any other size are rejected
+	ASSERT_TRUE(kv->put("short", "x") != status::OK);
+	ASSERT_TRUE(kv->put(std::string(PMKV_FIXED_KEY_SIZE + 1, 'k'), "x") != status::OK);
+
+	// enough to resize the index several times
+	const int items = 50000;
+	auto key = [](int i) {
+		std::string istr = std::to_string(i);
+		return std::string(PMKV_FIXED_KEY_SIZE - istr.size(), '0') + istr;
+	};
+	for (int i = 0; i < items; i++)
+		ASSERT_TRUE(kv->put(key(i), std::to_string(i)) == status::OK) << errormsg();
+	for (int i = 0; i < items; i += 2) {
+		ASSERT_TRUE(kv->put(key(i), std::to_string(-i)) == status::OK);
+		ASSERT_TRUE(kv->remove(key(i + 1)) == status::OK);
+	}
+	ASSERT_TRUE(kv->exists("short") == status::NOT_FOUND);
+
+	// the key size recorded at create wins over what reopen asks for
+	for (int pass = 0; pass < 2; pass++) {
+		size_t cnt;
+		ASSERT_TRUE(kv->count_all(cnt) == status::OK && cnt == items / 2);
+		struct pmkv_stats st;
+		ASSERT_TRUE(kv->stats(&st) == status::OK);
+		ASSERT_TRUE(st.key_size == PMKV_FIXED_KEY_SIZE);
+		for (int i = 0; i < items; i++) {
+			std::string value;
+			if (i % 2 == 0) {
+				ASSERT_TRUE(kv->get(key(i), &value) == status::OK);
+				ASSERT_TRUE(value == std::to_string(-i));
+			} else {
+				ASSERT_TRUE(kv->exists(key(i)) == status::NOT_FOUND);
+			}
+		}
+		Restart();
+	}
+}
+
+TEST_F(PMKVTest, NumaTest)
+{
+	files = { PATH + ".node0", PATH + ".node1" };
+	delete kv;
+	for (auto &p : files)
+		std::remove(p.c_str());
+	struct pmkv_options opts = {};
+	opts.node_paths[0] = files[0].c_str();
+	opts.node_paths[1] = files[1].c_str();
+	opts.nodes = 2;
+	Start(true, opts);
+	ASSERT_TRUE(kv->is_db_valid());
+	ASSERT_TRUE(kv->nodes() == 2);
+
+	const int items = 20000;
+	int per_node[2] = {};
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		int node = kv->key_node(kv->hash(istr));
+		ASSERT_TRUE(node == 0 || node == 1);
+		per_node[node]++;
+		ASSERT_TRUE(kv->put(istr, istr) == status::OK) << errormsg();
+	}
+	ASSERT_TRUE(per_node[0] > items / 3 && per_node[1] > items / 3);
+
+	// only the store's own nodes can be bound
+	ASSERT_TRUE(kv->bind_thread(-1) != status::OK);
+	ASSERT_TRUE(kv->bind_thread(2) != status::OK);
+
+	// node 0 exists everywhere; accesses of bound threads are counted
+	std::atomic<int> bound_ops(0);
+	parallel_exec(2, [&](size_t node) {
+		if (kv->bind_thread((int)node) != status::OK)
+			return;
+		for (int i = 0; i < items; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			ASSERT_TRUE(kv->get(istr, &value) == status::OK && value == istr);
+		}
+		bound_ops += items;
+	});
+	struct pmkv_stats st;
+	ASSERT_TRUE(kv->stats(&st) == status::OK);
+	ASSERT_TRUE(st.nodes == 2);
+	ASSERT_TRUE(bound_ops > 0);
+	ASSERT_TRUE(st.numa_local + st.numa_remote == (size_t)bound_ops);
+
+	Restart(opts);
+	ASSERT_TRUE(kv->is_db_valid());
+	size_t cnt;
+	ASSERT_TRUE(kv->count_all(cnt) == status::OK && cnt == items);
+
+	// a node pool only opens as part of the store it was created for
+	delete kv;
+	kv = new PMKVWrapper(files[1], SIZE, false);
+	ASSERT_FALSE(kv->is_db_valid());
+	delete kv;
+	std::swap(opts.node_paths[0], opts.node_paths[1]);
+	Start(false, opts);
+	ASSERT_FALSE(kv->is_db_valid());
+
+	// the path is a single pool, commas and all
+	delete kv;
+	PATH = files[0] + ",node1";
+	files.push_back(PATH);
+	Start(true);
+	ASSERT_TRUE(kv->is_db_valid());
+	ASSERT_TRUE(kv->nodes() == 1);
+}
+
+TEST_F(PMKVTest, PoolsetTest)
+{
+	const std::string parts[] = { PATH + ".part0", PATH + ".part1" };
+	delete kv;
+	for (auto &p : parts)
+		std::remove(p.c_str());
+	PATH += ".set";
+	FILE *set = fopen(PATH.c_str(), "w");
+	ASSERT_TRUE(set != NULL);
+	fprintf(set, "PMEMPOOLSET\n128M %s\n128M %s\n", parts[0].c_str(), parts[1].c_str());
+	fclose(set);
+
+	// the set file decides the size, whatever is passed in
+	Start(true);
+	ASSERT_TRUE(kv->is_db_valid());
+	// more than the first part holds
+	const int items = 320;
+	const std::string big(400 * 1024, 'v');
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, istr + big) == status::OK) << errormsg();
+	}
+	for (int pass = 0; pass < 2; pass++) {
+		size_t cnt;
+		ASSERT_TRUE(kv->count_all(cnt) == status::OK && cnt == items);
+		for (int i = 0; i < items; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			ASSERT_TRUE(kv->get(istr, &value) == status::OK && value == istr + big);
+		}
+		Restart();
+		ASSERT_TRUE(kv->is_db_valid());
+	}
+	std::remove(PATH.c_str());
+	for (auto &p : parts)
+		std::remove(p.c_str());
+}
+
+TEST_F(PMKVTest, PoolsetGrowTest)
+{
+	const std::string file = PATH;
+	files = { PATH + ".parts", PATH + ".set" };
+	delete kv;
+	for (auto &f : files)
+		remove_pool(f);
+	ASSERT_TRUE(mkdir(files[0].c_str(), 0755) == 0);
+	FILE *set = fopen(files[1].c_str(), "w");
+	ASSERT_TRUE(set != NULL);
+	// a directory part: libpmemobj adds part files to it as the pool grows
+	fprintf(set, "PMEMPOOLSET\n2G %s\n", files[0].c_str());
+	fclose(set);
+	PATH = files[1];
+	Start(true);
+	ASSERT_TRUE(kv->is_db_valid());
+	const int items = 1000;
+	for (int i = 0; i < items; i++) {
+		std::string istr = std::to_string(i);
+		ASSERT_TRUE(kv->put(istr, istr + std::string(1000, 'v')) == status::OK) << errormsg();
+	}
+	struct pmkv_stats before, after;
+	ASSERT_TRUE(kv->stats(&before) == status::OK);
+	ASSERT_TRUE(before.pool_bytes > 0);
+
+	struct pmkv_options opts = {};
+	opts.grow_bytes = 256ull << 20;
+	Restart(opts);
+	ASSERT_TRUE(kv->is_db_valid());
+	ASSERT_TRUE(kv->stats(&after) == status::OK);
+	ASSERT_TRUE(after.pool_bytes >= before.pool_bytes + opts.grow_bytes);
+	for (int pass = 0; pass < 2; pass++) {
+		size_t cnt;
+		ASSERT_TRUE(kv->count_all(cnt) == status::OK && cnt == items);
+		for (int i = 0; i < items; i++) {
+			std::string istr = std::to_string(i);
+			std::string value;
+			ASSERT_TRUE(kv->get(istr, &value) == status::OK);
+			ASSERT_TRUE(value == istr + std::string(1000, 'v'));
+		}
+		// the added part stays
+		Restart();
+		ASSERT_TRUE(kv->is_db_valid());
+		ASSERT_TRUE(kv->stats(&after) == status::OK);
+		ASSERT_TRUE(after.pool_bytes >= before.pool_bytes + opts.grow_bytes);
+	}
+
+	// a plain pool file cannot grow, and still opens without grow_bytes
+	delete kv;
+	kv = new PMKVWrapper(file, SIZE, false, opts);
+	ASSERT_FALSE(kv->is_db_valid());
+	delete kv;
+	kv = new PMKVWrapper(file, SIZE, false);
+	ASSERT_TRUE(kv->is_db_valid());
+}
+
+TEST_F(PMKVTest, CompressionTest)
+{
+	struct pmkv_options opts = {};
+	opts.codec = PMKV_CODEC_ZSTD;
+	opts.compress_min = 1024;
+	Restart(opts);
+	ASSERT_TRUE(kv->is_db_valid());
+
+	// runs, repeats at many distances, and random bytes that do not compress
+	auto value = [](int i) {
+		std::string v;
+		size_t size = 512 + (i * 7919) % 200000;
+		unsigned seed = i;
+		while (v.size() < size) {
+			seed = seed * 1103515245 + 12345;
+			switch ((seed >> 16) % 4) {
+			case 0: v.append((seed >> 8) % 300, 'a' + i % 26); break;
+			case 1: v.append(v, v.size() / 2, (seed >> 4) % 100); break;
+			case 2: v.append(std::to_string(seed)); break;
+			default: if (i % 3 == 0) v.push_back((char)(seed >> 24)); break;
+			}
+		}
+		v.resize(size);
+		return v;
+	};
+	const int items = 2000;
+	size_t raw = 0;
+	for (int i = 0; i < items; i++) {
+		raw += value(i).size();
+		ASSERT_TRUE(kv->put(std::to_string(i), value(i)) == status::OK) << errormsg();
+	}
+	struct pmkv_stats st;
+	ASSERT_TRUE(kv->stats(&st) == status::OK);
+	ASSERT_TRUE(st.compressed_puts > 0);
+	ASSERT_TRUE(st.live_bytes < raw);
+
+	// records carry their codec, so turning compression off keeps them readable
+	Restart();
+	for (int i = 0; i < items; i += 2)
+		ASSERT_TRUE(kv->put(std::to_string(i), value(i + items)) == status::OK);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < items; i++) {
+			std::string value_out;
+			ASSERT_TRUE(kv->get(std::to_string(i), &value_out) == status::OK);
+			ASSERT_TRUE(value_out == value(i % 2 == 0 ? i + items : i));
+		}
+		Restart(opts);
+	}
+}
+
+// frames of codec_text() from the zstd 1.5.6 command line tool:
+// "zstd -1" (with its default XXH64 checksum) and "zstd -19 --no-check"
+static const unsigned char zstd_ref_l1[] = {
+	0x28, 0xb5, 0x2f, 0xfd, 0x64, 0xb7, 0x0f, 0x85, 0x0c, 0x00, 0xa6, 0x98,
+	0x35, 0x14, 0xb0, 0x69, 0x39, 0xac, 0x4b, 0x85, 0x8e, 0x1a, 0x16, 0x91,
+	0x52, 0x92, 0x32, 0xc9, 0x24, 0x44, 0xcb, 0x15, 0x29, 0x10, 0x3b, 0x00,
+	0x2a, 0x00, 0x2d, 0x00, 0x8c, 0x49, 0xcd, 0xb9, 0xf1, 0x5d, 0x9a, 0x8c,
+	0xea, 0x7c, 0x0d, 0xb9, 0x49, 0x48, 0x88, 0xf8, 0x2c, 0x9f, 0xad, 0x29,
+	0x1a, 0x95, 0xf0, 0xc3, 0x89, 0x00, 0x44, 0x40, 0xc1, 0x82, 0xc1, 0x00,
+	0x43, 0x40, 0x44, 0x84, 0x1c, 0x1a, 0x10, 0x12, 0x04, 0x1a, 0x11, 0x87,
+	0x02, 0x03, 0x82, 0x01, 0x05, 0x81, 0x31, 0xe2, 0xa0, 0x70, 0x30, 0x70,
+	0x50, 0xa0, 0x10, 0x3c, 0x4d, 0xb2, 0x4e, 0x8a, 0x32, 0xc4, 0x0f, 0x39,
+	0xf2, 0xb0, 0xd5, 0xb1, 0x84, 0x13, 0x15, 0xa4, 0x97, 0xf4, 0x3a, 0xfd,
+	0x57, 0xe3, 0x8d, 0x86, 0x84, 0xfb, 0x4c, 0x37, 0xf5, 0xf9, 0xd0, 0x73,
+	0xb7, 0xae, 0xb5, 0x5a, 0x69, 0xa3, 0x99, 0x23, 0x17, 0xd4, 0x93, 0xe5,
+	0xf4, 0xb2, 0x4a, 0x27, 0x8f, 0xf6, 0x55, 0x96, 0xa0, 0xba, 0xa6, 0x3a,
+	0xa3, 0x10, 0xba, 0x9f, 0x21, 0xaf, 0x62, 0x2a, 0xf5, 0xa8, 0xa8, 0xf3,
+	0x34, 0x1d, 0x93, 0x69, 0x25, 0xa2, 0x14, 0x0d, 0xd1, 0x49, 0x9e, 0x90,
+	0xae, 0x84, 0x82, 0x82, 0x1a, 0x01, 0x00, 0x9e, 0xff, 0xf2, 0xd9, 0x0f,
+	0x57, 0x1f, 0x3d, 0xca, 0x7c, 0xcd, 0x6d, 0xee, 0x14, 0x23, 0x97, 0xf8,
+	0x6f, 0xaa, 0xda, 0x54, 0x57, 0x58, 0xe6, 0xa8, 0x74, 0x7c, 0xcc, 0xce,
+	0x25, 0xb1, 0x30, 0xbc, 0x77, 0x21, 0x2e, 0xdf, 0xbe, 0x55, 0x56, 0x80,
+	0xc6, 0xa8, 0x21, 0x60, 0x9f, 0xf7, 0xff, 0x0c, 0x90, 0x33, 0x92, 0xa6,
+	0x03, 0x11, 0x8c, 0x76, 0x44, 0xf8, 0x7f, 0xd3, 0xf5, 0x01, 0x00, 0xcc,
+	0xc1, 0x1d, 0xdf, 0xb8, 0x97, 0x0c, 0x47, 0x30, 0x9d, 0x00, 0x47, 0xc9,
+	0x99, 0x01, 0x24, 0xba, 0x7e, 0xb1, 0x30, 0x9a, 0x6a, 0xe1, 0x34, 0x5d,
+	0x2e, 0xc9, 0x60, 0xf3, 0x98, 0x1f, 0x90, 0xbe, 0x1e, 0xe7, 0x2c, 0x65,
+	0x72, 0xc0, 0x1c, 0x55, 0x27, 0xa3, 0x9d, 0x68, 0xd4, 0x67, 0x6e, 0xc3,
+	0x30, 0x93, 0x1e, 0x76, 0x6f, 0x04, 0x79, 0x94, 0xc3, 0xfd, 0x42, 0x5e,
+	0x87, 0x97, 0x8c, 0xc4, 0x45, 0x0f, 0xe4, 0x96, 0x34, 0xdc, 0x12, 0x66,
+	0xc1, 0xb9, 0xe8, 0x76, 0x76, 0x35, 0x04, 0xa0, 0x4e, 0x07, 0x1a, 0x4c,
+	0x0a, 0x17, 0x7a, 0x00, 0x03, 0x35, 0x54, 0xaa, 0xac, 0x10, 0xc6, 0xdb,
+	0x84, 0x18, 0xf1, 0xc3, 0x70, 0x19, 0x8e, 0xc4, 0x75, 0x21, 0xc8, 0x66,
+	0x5d, 0x03, 0x61, 0xe3, 0xb9, 0xa6, 0x16, 0x1a, 0xed, 0x60, 0xae, 0x6b,
+	0x85, 0x46, 0x3b, 0x88, 0x19, 0xbb, 0x0a, 0xd1, 0xfb, 0x81, 0xcb, 0x6a,
+	0x4d, 0xad, 0x14, 0xbb, 0xb5, 0x01, 0x98, 0xd9, 0xa9, 0xb6, 0xf4, 0x54,
+	0xc9, 0xec, 0x31, 0x8d, 0x6f, 0x98, 0x6e, 0x10, 0xc5, 0x8c, 0x30, 0x10,
+	0x55, 0x01, 0x60, 0x5f, 0xc3, 0x66,
+};
+static const unsigned char zstd_ref_l19[] = {
+	0x28, 0xb5, 0x2f, 0xfd, 0x60, 0xb7, 0x0f, 0xad, 0x0a, 0x00, 0xa6, 0x99,
+	0x37, 0x14, 0xb0, 0x69, 0x39, 0xac, 0x4b, 0x85, 0x8e, 0x1a, 0x16, 0x91,
+	0xa4, 0x94, 0x32, 0xc9, 0x14, 0x7b, 0x63, 0xc9, 0x2a, 0x06, 0x3b, 0x00,
+	0x2d, 0x00, 0x2e, 0x00, 0xe6, 0xe6, 0x95, 0x73, 0x37, 0xea, 0x45, 0x23,
+	0x23, 0xad, 0xcc, 0xfd, 0x09, 0xbb, 0x2c, 0x37, 0x8e, 0xac, 0x7b, 0xea,
+	0xa6, 0x89, 0x91, 0xca, 0xd0, 0x0f, 0x97, 0x04, 0x58, 0x40, 0xc1, 0x82,
+	0xc1, 0x00, 0x43, 0xc0, 0x78, 0x68, 0x40, 0x48, 0x10, 0xa0, 0x6d, 0x87,
+	0x02, 0x03, 0x82, 0x01, 0x05, 0x81, 0x7a, 0x3b, 0x28, 0x1c, 0x0c, 0x1c,
+	0x14, 0x28, 0x04, 0xfe, 0x18, 0x25, 0x2c, 0xb5, 0x1c, 0x86, 0x3c, 0xee,
+	0x4a, 0x05, 0x0d, 0xd5, 0xc5, 0xd8, 0xcc, 0xae, 0x9c, 0xec, 0x2a, 0x05,
+	0xfd, 0x53, 0xad, 0x5c, 0xe8, 0x3e, 0xa8, 0xe5, 0x70, 0xfb, 0x82, 0xae,
+	0xbb, 0xea, 0x25, 0x1a, 0x1a, 0xe9, 0xc8, 0x90, 0x5f, 0x09, 0x57, 0x19,
+	0xbc, 0x6d, 0x47, 0xfc, 0xec, 0x08, 0xcb, 0x8f, 0x82, 0xe8, 0x13, 0x53,
+	0x9c, 0x50, 0x4d, 0x0c, 0x45, 0xa5, 0x46, 0x17, 0x3d, 0x42, 0xaa, 0x0b,
+	0xe2, 0x37, 0x9b, 0xdd, 0x0f, 0x8a, 0x2a, 0x29, 0x89, 0x39, 0x0e, 0x69,
+	0x6f, 0x61, 0xc5, 0x48, 0xa5, 0x0d, 0x67, 0x32, 0xa1, 0x05, 0x00, 0xd5,
+	0x3a, 0x63, 0x6a, 0xc2, 0x14, 0xee, 0x54, 0x64, 0x53, 0x0e, 0x9a, 0xa8,
+	0x72, 0x65, 0x41, 0x97, 0x7b, 0xfd, 0xcb, 0x50, 0xed, 0x42, 0x44, 0xcf,
+	0xb8, 0x42, 0x64, 0xda, 0xa3, 0xa6, 0x9e, 0x84, 0x45, 0xaf, 0x2e, 0x7d,
+	0xc7, 0xb2, 0x4f, 0x3c, 0xcd, 0x3c, 0x12, 0x80, 0xc7, 0xa8, 0x11, 0xf0,
+	0xb1, 0xde, 0xd9, 0xdf, 0xe0, 0x2d, 0x07, 0x21, 0x04, 0x6e, 0x26, 0xfc,
+	0xff, 0x90, 0x0f, 0x9d, 0x3c, 0x7e, 0xd2, 0xf3, 0xb5, 0x2d, 0xde, 0x9d,
+	0x01, 0x59, 0xd7, 0x8b, 0x27, 0xc5, 0xcd, 0xcf, 0xcf, 0x0c, 0x1c, 0x3b,
+	0x79, 0x3c, 0x88, 0xcf, 0xa2, 0x31, 0x48, 0xde, 0xce, 0xc0, 0xb1, 0xdf,
+	0x8e, 0x01, 0x8e, 0x6f, 0xfe, 0x9b, 0x62, 0xed, 0xe7, 0xa7, 0x6c, 0xc0,
+	0x9b, 0xfc, 0xaf, 0x13, 0xf9, 0xeb, 0xce, 0x80, 0xb8, 0x6a, 0xf0, 0x9c,
+	0x81, 0x17, 0x43, 0x8e, 0x19, 0xf4, 0x44, 0x10, 0x19, 0x61, 0x02, 0xda,
+	0xe8, 0xdb, 0x32, 0x9f, 0x51, 0x85, 0xcb, 0xe4, 0xc6, 0x0f, 0xb4, 0x9b,
+	0x86, 0x2d, 0xc7, 0xfb, 0xf2, 0xdb, 0x34, 0xa8, 0xb3, 0x1c, 0xb3, 0xd5,
+	0x80, 0x56, 0x05,
+};
+
+static std::string codec_text()
+{
+	std::string s;
+	for (int i = 0; i < 100; i++)
+		s += "tenant-0042/table-0007/row-" + std::to_string(10000 + i) +
+			" value " + std::to_string(i * i % 997) + "\n";
+	return s;
+}
+
+TEST_F(PMKVTest, CodecTest)
+{
+	const std::string plain = codec_text();
+	std::vector<char> out(plain.size());
+
+	// the reference encoder's frames decode
+	const struct { const unsigned char *data; size_t size; } refs[] = {
+		{ zstd_ref_l1, sizeof(zstd_ref_l1) },
+		{ zstd_ref_l19, sizeof(zstd_ref_l19) },
+	};
+	for (auto &ref : refs) {
+		long n = codec_decompress(PMKV_CODEC_ZSTD, (const char *)ref.data, ref.size,
+				out.data(), out.size());
+		ASSERT_TRUE(n == (long)plain.size());
+		ASSERT_TRUE(std::string(out.data(), n) == plain);
+	}
+
+	// damaged, truncated, or too large for the buffer
+	std::string bad((const char *)zstd_ref_l1, sizeof(zstd_ref_l1));
+	bad[bad.size() / 2] ^= 0x20;
+	ASSERT_TRUE(codec_decompress(PMKV_CODEC_ZSTD, bad.data(), bad.size(),
+			out.data(), out.size()) == -1);
+	ASSERT_TRUE(codec_decompress(PMKV_CODEC_ZSTD, (const char *)zstd_ref_l1,
+			sizeof(zstd_ref_l1) - 8, out.data(), out.size()) == -1);
+	ASSERT_TRUE(codec_decompress(PMKV_CODEC_ZSTD, (const char *)zstd_ref_l1,
+			sizeof(zstd_ref_l1), out.data(), out.size() - 1) == -1);
+
+	// our frames decode back, and an output that does not fit is refused
+	std::vector<char> frame(plain.size());
+	size_t size = codec_compress(PMKV_CODEC_ZSTD, plain.data(), plain.size(),
+			frame.data(), frame.size());
+	ASSERT_TRUE(size > 0 && size < plain.size() / 4);
+	ASSERT_TRUE(codec_decompress(PMKV_CODEC_ZSTD, frame.data(), size,
+			out.data(), out.size()) == (long)plain.size());
+	ASSERT_TRUE(std::string(out.data(), plain.size()) == plain);
+	ASSERT_TRUE(codec_compress(PMKV_CODEC_ZSTD, plain.data(), plain.size(),
+			frame.data(), size - 1) == 0);
+
+	// codec 0 stores values as they are
+	ASSERT_TRUE(codec_compress(PMKV_CODEC_NONE, plain.data(), plain.size(),
+			frame.data(), frame.size()) == 0);
+}
+
+TEST_F(PMKVTest, FootprintTest)
+{
+	ASSERT_TRUE(kv->is_db_valid());
+	auto check = [this](struct pmkv_stats *st) {
+		ASSERT_TRUE(kv->stats(st) == status::OK);
+		size_t classes = 0;
+		for (int i = 0; i < PMKV_SIZE_CLASSES; i++)
+			classes += st->alloc_bytes[i];
+		ASSERT_TRUE(classes == st->allocated_bytes);
+		ASSERT_TRUE(st->pool_bytes == SIZE);
+		ASSERT_TRUE(st->free_bytes == st->pool_bytes - st->allocated_bytes);
+		ASSERT_TRUE(st->allocated_bytes >= st->log_bytes + st->index_bytes);
+		ASSERT_TRUE(st->dram_index_bytes >= st->filter_bytes);
+		ASSERT_TRUE(st->fragmentation >= 0 && st->fragmentation < 1);
+	};
+	struct pmkv_stats st;
+	check(&st);
+	ASSERT_TRUE(st.live_keys == 0);
+	size_t empty = st.allocated_bytes;
+
+	const int items = 50000;
+	for (int i = 0; i < items; i++)
+		ASSERT_TRUE(kv->put(std::to_string(i), std::string(200, 'a')) == status::OK) << errormsg();
+	check(&st);
+	ASSERT_TRUE(st.live_keys == items);
+	ASSERT_TRUE(st.allocated_bytes > empty + items * 200);
+	// log chunks are just under 1 MiB
+	ASSERT_TRUE(st.alloc_bytes[8] >= st.log_bytes);
+
+	for (int i = 0; i < items; i++) {
+		if (i % 4 == 0)
+			ASSERT_TRUE(kv->remove(std::to_string(i)) == status::OK);
+		else
+			ASSERT_TRUE(kv->put(std::to_string(i), std::string(208, 'b')) == status::OK);
+	}
+	check(&st);
+	ASSERT_TRUE(st.live_keys == items - items / 4);
+	double fragmented = st.fragmentation;
+	ASSERT_TRUE(fragmented > 0.3);
+	ASSERT_TRUE(kv->compact() == status::OK);
+	check(&st);
+	ASSERT_TRUE(st.fragmentation < fragmented);
+	Restart();
+	check(&st);
+	ASSERT_TRUE(st.live_keys == items - items / 4);
+}
+
 const int LARGE_LIMIT = 500000;
 
 TEST_F(PMKVLargeTest, LargeAscendingTest)
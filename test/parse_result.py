@@ -22,6 +22,23 @@ spec = [
         'PMKVTest.RemoveHeadlessTest',
         'PMKVTest.RemoveNonexistentTest',
         'PMKVTest.SimpleMultithreadedTest',
+        'PMKVTest.InPlaceUpdateTest',
+        'PMKVTest.InPlaceRecoveryTest',
+        'PMKVTest.CompactionTest',
+        'PMKVTest.ShrinkTest',
+        'PMKVTest.ResizeResumeTest',
+        'PMKVTest.FingerprintTest',
+        'PMKVTest.FilterTest',
+        'PMKVTest.CacheTest',
+        'PMKVTest.HashedTest',
+        'PMKVTest.HashKernelTest',
+        'PMKVTest.FixedKeyTest',
+        'PMKVTest.NumaTest',
+        'PMKVTest.PoolsetTest',
+        'PMKVTest.PoolsetGrowTest',
+        'PMKVTest.CompressionTest',
+        'PMKVTest.CodecTest',
+        'PMKVTest.FootprintTest',
         'PMKVLargeTest.LargeAscendingTest',
         'PMKVLargeTest.LargeAscendingAfterRecoveryTest',
         'PMKVLargeTest.LargeDescendingTest',